@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// minimal offline microbenchmark harness
+// every case is calibrated to a batch of iterations lasting at least minBatchMs, warmed up and then timed per batch
+namespace Bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    // keeps the compiler from discarding a computed value
+    template<typename T>
+    inline void doNotOptimize(const T& value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    struct Settings
+    {
+        int warmup = 3;
+        int repetitions = 15;
+        double minBatchMs = 5.0;
+        std::string filter;
+    };
+
+    struct Result
+    {
+        std::string name;
+        long long iterations = 0;
+        int repetitions = 0;
+        double median = 0.0;
+        double p10 = 0.0;
+        double p90 = 0.0;
+        double min = 0.0;
+        double mean = 0.0;
+    };
+
+    class Suite
+    {
+    public:
+        // the body runs one operation, state it needs is captured by reference
+        using Body = std::function<void()>;
+
+        explicit Suite(const Settings& settings) : settings(settings) {}
+
+        void add(const std::string& name, Body body)
+        {
+            if (settings.filter.empty() || name.find(settings.filter) != std::string::npos)
+                cases.push_back({ name, std::move(body) });
+        }
+
+        std::vector<Result> run() const
+        {
+            std::vector<Result> results;
+            for (const auto& c : cases)
+                results.push_back(measure(c));
+            return results;
+        }
+
+        static void printJson(std::ostream& os, const std::vector<Result>& results)
+        {
+            const auto flags = os.flags();
+            const auto precision = os.precision();
+            os.setf(std::ios::fixed);
+            os.precision(2);
+            os << "{\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [";
+            for (std::size_t i = 0; i < results.size(); i++)
+            {
+                const auto& r = results[i];
+                os << (i == 0 ? "\n" : ",\n");
+                os << "    { \"name\": \"" << r.name << "\", \"iterations\": " << r.iterations << ", \"repetitions\": " << r.repetitions
+                   << ", \"median\": " << r.median << ", \"p10\": " << r.p10 << ", \"p90\": " << r.p90
+                   << ", \"min\": " << r.min << ", \"mean\": " << r.mean << " }";
+            }
+            os << "\n  ]\n}\n";
+            os.flags(flags);
+            os.precision(precision);
+        }
+
+        static void printCsv(std::ostream& os, const std::vector<Result>& results)
+        {
+            const auto flags = os.flags();
+            const auto precision = os.precision();
+            os.setf(std::ios::fixed);
+            os.precision(2);
+            os << "name,iterations,repetitions,median_ns,p10_ns,p90_ns,min_ns,mean_ns\n";
+            for (const auto& r : results)
+                os << r.name << ',' << r.iterations << ',' << r.repetitions << ',' << r.median << ',' << r.p10 << ','
+                   << r.p90 << ',' << r.min << ',' << r.mean << '\n';
+            os.flags(flags);
+            os.precision(precision);
+        }
+
+    private:
+        struct Case
+        {
+            std::string name;
+            Body body;
+        };
+
+        Settings settings;
+        std::vector<Case> cases;
+
+        static double batchNs(const Body& body, long long iterations)
+        {
+            const auto start = Clock::now();
+            for (long long i = 0; i < iterations; i++)
+                body();
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        }
+
+        // nearest-rank percentile of sorted samples
+        static double percentile(const std::vector<double>& sorted, double p)
+        {
+            const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+            return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+        }
+
+        [[nodiscard]] Result measure(const Case& c) const
+        {
+            // grow the batch until it is long enough for the clock resolution to vanish
+            const auto minNs = settings.minBatchMs * 1e6;
+            long long iterations = 1;
+            for (auto ns = batchNs(c.body, iterations); ns < minNs; ns = batchNs(c.body, iterations))
+                iterations = ns < minNs / 100.0 ? iterations * 10 : static_cast<long long>(static_cast<double>(iterations) * minNs / ns) + 1;
+
+            for (auto i = 0; i < settings.warmup; i++)
+                batchNs(c.body, iterations);
+
+            std::vector<double> perOp;
+            for (auto i = 0; i < settings.repetitions; i++)
+                perOp.push_back(batchNs(c.body, iterations) / static_cast<double>(iterations));
+            std::sort(perOp.begin(), perOp.end());
+
+            Result r;
+            r.name = c.name;
+            r.iterations = iterations;
+            r.repetitions = settings.repetitions;
+            r.median = percentile(perOp, 0.5);
+            r.p10 = percentile(perOp, 0.1);
+            r.p90 = percentile(perOp, 0.9);
+            r.min = perOp.front();
+            for (const auto v : perOp)
+                r.mean += v;
+            r.mean /= static_cast<double>(perOp.size());
+            return r;
+        }
+    };
+}
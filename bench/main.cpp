@@ -0,0 +1,106 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "InputParser.h"
+#include "Benchmark.h"
+#include "SpectralData.h"
+#include "Spectrum.h"
+#include "Sampler.h"
+#include "Quadrature.h"
+#include "Fluorescence.h"
+#include "ColorSpace.h"
+#include "Polarization.h"
+#include "Scene.h"
+
+// fixed inputs so numbers are comparable between builds
+void addSpectrumCases(Bench::Suite& suite)
+{
+    static Spectrum::Parser parser;
+    static const auto lumArbitrary = parser.parseMathematicaString(Data::CIE_Illuminant_D65);
+    static const auto lum = lumArbitrary.toVisibleFull();
+    static const auto mat = parser.parseMathematicaString(Data::XRite_Reflectance_E2).toVisibleFull();
+    static Sampler::Uniform uniform(1);
+    static Sampler::Hero<> hero(1);
+
+    suite.add("spectrum.multiply", [] { Bench::doNotOptimize(lum * mat); });
+    suite.add("spectrum.sum", [] { Bench::doNotOptimize(lum.sum()); });
+    suite.add("spectrum.toVisibleFull", [] { Bench::doNotOptimize(lumArbitrary.toVisibleFull()); });
+    suite.add("spectrum.parse", [] { Bench::doNotOptimize(parser.parseMathematicaString(Data::CIE_Illuminant_D65)); });
+    suite.add("colorspace.xyz", [] { Bench::doNotOptimize(ColorSpace::XYZ(mat).color); });
+    suite.add("sampler.uniform.100", [] { Bench::doNotOptimize(uniform.eval(100, lum, mat)); });
+    suite.add("sampler.hero.100", [] { Bench::doNotOptimize(hero.eval(100 / Sampler::Hero<>::LANES, lum, mat)); });
+    static const auto& midpoint = Quadrature::rule(Quadrature::Method::eMidpoint, 40);
+    static const auto& gauss = Quadrature::rule(Quadrature::Method::eGaussLegendre, 40);
+    suite.add("quadrature.midpoint.40", [] { Bench::doNotOptimize(midpoint.eval(lum, mat)); });
+    suite.add("quadrature.gauss.40", [] { Bench::doNotOptimize(gauss.eval(lum, mat)); });
+    suite.add("quadrature.gauss.40.xyz", [] { Bench::doNotOptimize(gauss.xyz(lum, mat)); });
+    suite.add("quadrature.adaptive.40", [] { Bench::doNotOptimize(Quadrature::Adaptive::eval(40, lum, mat)); });
+
+    static const auto matrix = Fluorescence::synthetic(mat, 420.0f, 480.0f, 20.0f, 0.3f);
+    static const Fluorescence::Sparse sparse(matrix);
+    static const Fluorescence::LowRank lowRank(matrix, 4);
+    static const Fluorescence::Material material(matrix);
+    static std::vector<float> in(3 * Fluorescence::N, 1.0f), out(in.size());
+    suite.add("fluorescence.dense.multiply.1", [] { matrix.multiply(in.data(), out.data(), 1); Bench::doNotOptimize(out[0]); });
+    suite.add("fluorescence.dense.multiply.3", [] { matrix.multiply(in.data(), out.data(), 3); Bench::doNotOptimize(out[0]); });
+    suite.add("fluorescence.dense.multiplyTransposed.3", [] { matrix.multiplyTransposed(in.data(), out.data(), 3); Bench::doNotOptimize(out[0]); });
+    suite.add("fluorescence.sparse.multiply.3", [] { sparse.multiply(in.data(), out.data(), 3); Bench::doNotOptimize(out[0]); });
+    suite.add("fluorescence.lowrank.multiply.3", [] { lowRank.multiply(in.data(), out.data(), 3); Bench::doNotOptimize(out[0]); });
+    suite.add("fluorescence.material.xyz", [] { Bench::doNotOptimize(material.xyz(lum)); });
+}
+
+void addPolarizationCases(Bench::Suite& suite)
+{
+    static volatile float cosTheta = 0.6f;
+    static const auto mm = MuellerMatrix::FresnelReflectance(Fresnel<FresnelType::eConductor>(0.6f, 0.47f, 2.4f));
+    static const Scene::Scene scene{ 1, { 53.0f, 1.33f, 0.0f }, { 56.0f, 1.5f, 0.0f }, true, 45.0f, 30.0f };
+
+    suite.add("fresnel.general", [] { Bench::doNotOptimize(FresnelGeneral(cosTheta, 0.47f, 2.4f).r_s); });
+    suite.add("mueller.fresnelReflectance", [] { Bench::doNotOptimize(MuellerMatrix::FresnelReflectance(FresnelType::eGeneral, cosTheta, 0.47f, 2.4f)); });
+    suite.add("mueller.rotate", [] { Bench::doNotOptimize(MuellerMatrix::Rotate(mm, cosTheta)); });
+    suite.add("scene.traverse", [] { Bench::doNotOptimize(scene.traverse().sv); });
+}
+
+int main(int argc, char **argv)
+{
+    const InputParser input(argc, argv);
+    if (input.cmdOptionExists("-h") || input.cmdOptionExists("--help"))
+    {
+        std::cout << "bench [-w WARMUP] [-r REPETITIONS] [-t MIN_BATCH_MS] [-f FILTER] [--csv] [-o OUTPUT]\n";
+        return EXIT_SUCCESS;
+    }
+
+    Bench::Settings settings;
+    if (const auto o = input.getCmdOption("-w"); !o.empty())
+        settings.warmup = std::stoi(o);
+    if (const auto o = input.getCmdOption("-r"); !o.empty())
+        settings.repetitions = std::max(1, std::stoi(o));
+    if (const auto o = input.getCmdOption("-t"); !o.empty())
+        settings.minBatchMs = std::stod(o);
+    settings.filter = input.getCmdOption("-f");
+
+    // opened before the run so a bad path fails fast
+    std::ofstream file;
+    if (const auto& path = input.getCmdOption("-o"); !path.empty())
+    {
+        file.open(path);
+        if (!file)
+        {
+            std::cerr << "cannot open " << path << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    Bench::Suite suite(settings);
+    addSpectrumCases(suite);
+    addPolarizationCases(suite);
+    const auto results = suite.run();
+
+    auto& os = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+    if (input.cmdOptionExists("--csv"))
+        Bench::Suite::printCsv(os, results);
+    else
+        Bench::Suite::printJson(os, results);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// bounded lock-free multi-producer multi-consumer queue (Vyukov's sequence-numbered ring)
+// push blocks while the queue is full, which throttles faster upstream stages
+// pop returns false once the queue is drained and every producer has called close()
+// both only take the mutex to sleep on a condition variable when the ring is full or empty
+template<typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue(std::size_t capacity, int producerCount) : cells(new Cell[capacity]), mask(capacity - 1), producers(producerCount)
+    {
+        assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+        for (std::size_t i = 0; i < capacity; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    void push(T value)
+    {
+        if (!tryPush(value))
+        {
+            std::unique_lock lock(mutex);
+            sleep(waitingProducers, [&] { return tryPush(value); }, notFull, lock);
+        }
+        wake(waitingConsumers, notEmpty);
+    }
+
+    bool pop(T& value)
+    {
+        auto popped = tryPop(value);
+        if (!popped)
+        {
+            std::unique_lock lock(mutex);
+            sleep(waitingConsumers, [&]
+            {
+                if (tryPop(value))
+                    popped = true;
+                // a producer may have pushed right before closing
+                else if (producers.load(std::memory_order_acquire) == 0)
+                    popped = tryPop(value);
+                else
+                    return false;
+                return true;
+            }, notEmpty, lock);
+        }
+        if (popped)
+            wake(waitingProducers, notFull);
+        return popped;
+    }
+
+    void close()
+    {
+        producers.fetch_sub(1, std::memory_order_release);
+        std::lock_guard lock(mutex);
+        notEmpty.notify_all();
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    // keep the producer and consumer cursors on separate cache lines
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    std::unique_ptr<Cell[]> cells;
+    const std::size_t mask;
+    alignas(CACHE_LINE) std::atomic<std::size_t> enqueuePos = 0;
+    alignas(CACHE_LINE) std::atomic<std::size_t> dequeuePos = 0;
+    alignas(CACHE_LINE) std::atomic<int> producers;
+    std::atomic<int> waitingProducers = 0;
+    std::atomic<int> waitingConsumers = 0;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+    // the waiter count is published before the ring is checked again and read after the ring changed, so either
+    // the retry sees the change or the other side sees the waiter and notifies under the mutex
+    template<typename F>
+    void sleep(std::atomic<int>& waiting, F&& ready, std::condition_variable& cv, std::unique_lock<std::mutex>& lock)
+    {
+        waiting.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready())
+            cv.wait(lock);
+        waiting.fetch_sub(1);
+    }
+
+    void wake(std::atomic<int>& waiting, std::condition_variable& cv)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard lock(mutex);
+            cv.notify_all();
+        }
+    }
+
+    // value is moved from only on success
+    bool tryPush(T& value)
+    {
+        auto pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto& cell = cells[pos & mask];
+            const auto seq = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.data = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPop(T& value)
+    {
+        auto pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto& cell = cells[pos & mask];
+            const auto seq = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.data);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+};
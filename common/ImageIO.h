@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define IMAGE_IO_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define IMAGE_IO_MMAP 0
+#include <fstream>
+#include <vector>
+#endif
+
+namespace ImageIO
+{
+    // fixed size output file mapped into memory, bytes written by any thread land directly in the page cache
+    // platforms without mmap fall back to an in-memory buffer flushed on destruction
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::string& path, std::size_t size) : path(path), size(size)
+        {
+#if IMAGE_IO_MMAP
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+                throw std::runtime_error("cannot open " + path);
+            if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+            {
+                close(fd);
+                throw std::runtime_error("cannot resize " + path);
+            }
+            void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("cannot map " + path);
+            }
+            bytes = static_cast<char*>(p);
+#else
+            buffer.resize(size);
+            bytes = buffer.data();
+#endif
+        }
+
+        ~MappedFile()
+        {
+#if IMAGE_IO_MMAP
+            munmap(bytes, size);
+            close(fd);
+#else
+            std::ofstream(path, std::ios::binary).write(buffer.data(), static_cast<std::streamsize>(size));
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        [[nodiscard]] char* data() { return bytes; }
+
+    private:
+        std::string path;
+        std::size_t size;
+        char* bytes = nullptr;
+#if IMAGE_IO_MMAP
+        int fd = -1;
+#else
+        std::vector<char> buffer;
+#endif
+    };
+
+    // read-ahead hint for a mapped file
+    enum class Access
+    {
+        eSequential,
+        eRandom
+    };
+
+    // existing file mapped read-only, pages are faulted in on access and dropped by the kernel under pressure
+    // so arbitrarily large inputs stream with bounded resident memory
+    // platforms without mmap read the whole file instead
+    class MappedInput
+    {
+    public:
+        explicit MappedInput(const std::string& path, Access access = Access::eSequential)
+        {
+#if IMAGE_IO_MMAP
+            fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("cannot open " + path);
+            const auto end = lseek(fd, 0, SEEK_END);
+            if (end <= 0)
+            {
+                close(fd);
+                throw std::runtime_error("cannot read " + path);
+            }
+            size = static_cast<std::size_t>(end);
+            void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("cannot map " + path);
+            }
+            madvise(p, size, access == Access::eSequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+            bytes = static_cast<const char*>(p);
+#else
+            static_cast<void>(access);
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in)
+                throw std::runtime_error("cannot open " + path);
+            size = static_cast<std::size_t>(in.tellg());
+            buffer.resize(size);
+            in.seekg(0);
+            in.read(buffer.data(), static_cast<std::streamsize>(size));
+            bytes = buffer.data();
+#endif
+        }
+
+        ~MappedInput()
+        {
+#if IMAGE_IO_MMAP
+            munmap(const_cast<char*>(bytes), size);
+            close(fd);
+#endif
+        }
+
+        MappedInput(const MappedInput&) = delete;
+        MappedInput& operator=(const MappedInput&) = delete;
+
+        [[nodiscard]] const char* data() const { return bytes; }
+        [[nodiscard]] std::size_t bytesSize() const { return size; }
+
+    private:
+        std::size_t size = 0;
+        const char* bytes = nullptr;
+#if IMAGE_IO_MMAP
+        int fd = -1;
+#else
+        std::vector<char> buffer;
+#endif
+    };
+
+    // little-endian PFM, single channel ("Pf") or RGB ("PF"), scanlines are stored bottom to top
+    class PfmImage
+    {
+    public:
+        PfmImage(const std::string& path, int width, int height, int channels = 1) :
+            width(width), height(height), channels(channels), header(makeHeader(width, height, channels)),
+            file(path, header.size() + sizeof(float) * width * height * channels)
+        {
+            std::memcpy(file.data(), header.data(), header.size());
+        }
+
+        // y = 0 is the top row of the image
+        float& at(int x, int y, int channel = 0)
+        {
+            auto* pixels = reinterpret_cast<float*>(file.data() + header.size());
+            return pixels[(static_cast<std::size_t>(height - 1 - y) * width + x) * channels + channel];
+        }
+
+        const int width;
+        const int height;
+        const int channels;
+    private:
+        const std::string header;
+        MappedFile file;
+
+        static std::string makeHeader(int width, int height, int channels)
+        {
+            // pad with spaces so the pixel data starts 4-byte aligned
+            auto dims = std::to_string(width) + " " + std::to_string(height);
+            while ((dims.size() + 2 + 2 + 5) % sizeof(float) != 0)
+                dims.push_back(' ');
+            return (channels == 3 ? "PF\n" : "Pf\n") + dims + "\n-1.0\n";
+        }
+    };
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+class InputParser
+{
+public:
+    InputParser (int &argc, char **argv)
+    {
+        for (int i=1; i < argc; ++i)
+            tokens.emplace_back(argv[i]);
+    }
+
+    [[nodiscard]] const std::string& getCmdOption(const std::string& option) const
+    {
+        if (auto itr =  std::find(tokens.cbegin(), tokens.cend(), option);itr != tokens.cend() && ++itr != tokens.end())
+            return *itr;
+        return emptyString;
+    }
+
+    [[nodiscard]] bool cmdOptionExists(const std::string& option) const
+    {
+        return std::find(tokens.cbegin(), tokens.cend(), option) != tokens.cend();
+    }
+private:
+    std::vector <std::string> tokens;
+    std::string emptyString = {};
+};
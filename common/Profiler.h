@@ -0,0 +1,193 @@
+#pragma once
+
+// scoped timers and event counters, aggregated per thread
+// PROFILING_ENABLED=0 compiles every PROFILE_* macro to nothing, otherwise collection is switched on at runtime by Profiler::enable()
+#ifndef PROFILING_ENABLED
+#define PROFILING_ENABLED 1
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Profiler
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr int MAX_SITES = 64;
+
+    struct Counter
+    {
+        long long calls = 0;
+        long long ns = 0;
+        long long items = 0;
+
+        Counter& operator+=(const Counter& rhs)
+        {
+            calls += rhs.calls;
+            ns += rhs.ns;
+            items += rhs.items;
+            return *this;
+        }
+    };
+
+    using Counters = std::array<Counter, MAX_SITES>;
+
+    class Registry
+    {
+    public:
+        static Registry& get()
+        {
+            static Registry r;
+            return r;
+        }
+
+        int site(const char* name)
+        {
+            std::lock_guard lock(m);
+            for (std::size_t i = 0; i < names.size(); i++)
+                if (names[i] == name)
+                    return static_cast<int>(i);
+            assert(names.size() < MAX_SITES);
+            names.emplace_back(name);
+            return static_cast<int>(names.size() - 1);
+        }
+
+        void attach(Counters* c)
+        {
+            std::lock_guard lock(m);
+            live.push_back(c);
+            threadCount++;
+        }
+
+        // exiting threads fold their counters into the retired totals
+        void detach(Counters* c)
+        {
+            std::lock_guard lock(m);
+            for (auto i = 0; i < MAX_SITES; i++)
+                retired[i] += (*c)[i];
+            live.erase(std::find(live.begin(), live.end(), c));
+        }
+
+        // call once the profiled work has finished, live counters are read without synchronization
+        void printJson(std::ostream& os, double wallSeconds)
+        {
+            std::lock_guard lock(m);
+            auto totals = retired;
+            for (const auto* c : live)
+                for (auto i = 0; i < MAX_SITES; i++)
+                    totals[i] += (*c)[i];
+
+            const auto flags = os.flags();
+            const auto precision = os.precision();
+            os.setf(std::ios::fixed);
+            os.precision(3);
+            os << "{\n  \"wall_ms\": " << wallSeconds * 1e3 << ",\n  \"threads\": " << threadCount << ",\n  \"phases\": [";
+            for (std::size_t i = 0; i < names.size(); i++)
+            {
+                const auto& t = totals[i];
+                const auto seconds = static_cast<double>(t.ns) * 1e-9;
+                os << (i == 0 ? "\n" : ",\n");
+                os << "    { \"name\": \"" << names[i] << "\", \"calls\": " << t.calls << ", \"total_ms\": " << seconds * 1e3
+                   << ", \"mean_ns\": " << (t.calls > 0 ? static_cast<double>(t.ns) / static_cast<double>(t.calls) : 0.0)
+                   << ", \"items\": " << t.items
+                   << ", \"items_per_s\": " << (t.ns > 0 ? static_cast<double>(t.items) / seconds : 0.0) << " }";
+            }
+            os << "\n  ]\n}\n";
+            os.flags(flags);
+            os.precision(precision);
+        }
+
+    private:
+        std::mutex m;
+        std::vector<std::string> names;
+        std::vector<Counters*> live;
+        Counters retired{};
+        int threadCount = 0;
+    };
+
+    struct ThreadCounters
+    {
+        Counters counters{};
+        ThreadCounters() { Registry::get().attach(&counters); }
+        ~ThreadCounters() { Registry::get().detach(&counters); }
+    };
+
+    inline std::atomic<bool> enabled = false;
+    inline Clock::time_point startTime;
+
+    inline void enable()
+    {
+        startTime = Clock::now();
+        enabled = true;
+    }
+
+    inline Counter& counter(int site)
+    {
+        thread_local ThreadCounters t;
+        return t.counters[site];
+    }
+
+    inline void count(int site, long long items)
+    {
+        if (enabled.load(std::memory_order_relaxed))
+            counter(site).items += items;
+    }
+
+    inline void printJson(std::ostream& os)
+    {
+        const auto wall = std::chrono::duration<double>(Clock::now() - startTime).count();
+        Registry::get().printJson(os, wall);
+    }
+
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(int site) : site(site), active(enabled.load(std::memory_order_relaxed))
+        {
+            if (active)
+                start = Clock::now();
+        }
+
+        ~ScopedTimer()
+        {
+            if (!active)
+                return;
+            auto& c = counter(site);
+            c.calls++;
+            c.ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        int site;
+        bool active;
+        Clock::time_point start;
+    };
+}
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#if PROFILING_ENABLED
+// times the enclosing scope
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_CONCAT(profileSite_, __LINE__) = Profiler::Registry::get().site(name); \
+    const Profiler::ScopedTimer PROFILE_CONCAT(profileTimer_, __LINE__)(PROFILE_CONCAT(profileSite_, __LINE__))
+// adds processed items (samples, pixels, ...) to the site of the same name
+#define PROFILE_COUNT(name, n) \
+    do { \
+        static const int profileSite = Profiler::Registry::get().site(name); \
+        Profiler::count(profileSite, static_cast<long long>(n)); \
+    } while (false)
+#else
+#define PROFILE_SCOPE(name) do {} while (false)
+#define PROFILE_COUNT(name, n) do {} while (false)
+#endif
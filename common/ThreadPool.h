@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// persistent worker threads with one task deque per worker
+// owner pops from the back (LIFO, cache friendly), idle workers steal from the front of other deques
+class ThreadPool
+{
+public:
+    using Task = std::function<void(int item, unsigned worker)>;
+
+    explicit ThreadPool(unsigned threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        queues = std::vector<WorkQueue>(threadCount);
+        workers.reserve(threadCount);
+        for (unsigned i = 0; i < threadCount; i++)
+            workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(stateMutex);
+            stop = true;
+        }
+        wakeCv.notify_all();
+        for (auto& w : workers)
+            w.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    [[nodiscard]] unsigned size() const
+    {
+        return static_cast<unsigned>(workers.size());
+    }
+
+    // runs task(i, worker) for every i in [0, itemCount), blocks until all items are done
+    void parallelFor(int itemCount, const Task& task)
+    {
+        if (itemCount <= 0)
+            return;
+
+        std::unique_lock lock(stateMutex);
+        // set before publishing items, a worker still draining the previous job may pick them up right away
+        pending = itemCount;
+        for (int i = 0; i < itemCount; i++)
+        {
+            auto& q = queues[i % queues.size()];
+            std::lock_guard qLock(q.m);
+            q.items.emplace_back(&task, i);
+        }
+        generation++;
+        wakeCv.notify_all();
+
+        doneCv.wait(lock, [this] { return pending == 0; });
+    }
+
+private:
+    // each item carries its task so a late worker can never pair it with a newer job
+    using WorkItem = std::pair<const Task*, int>;
+
+    struct WorkQueue
+    {
+        std::mutex m;
+        std::deque<WorkItem> items;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<WorkQueue> queues;
+
+    std::mutex stateMutex;
+    std::condition_variable wakeCv;
+    std::condition_variable doneCv;
+    std::atomic<int> pending = 0;
+    unsigned long generation = 0;
+    bool stop = false;
+
+    std::optional<WorkItem> popLocal(unsigned worker)
+    {
+        auto& q = queues[worker];
+        std::lock_guard lock(q.m);
+        if (q.items.empty())
+            return std::nullopt;
+        const auto item = q.items.back();
+        q.items.pop_back();
+        return item;
+    }
+
+    std::optional<WorkItem> steal(unsigned thief)
+    {
+        for (std::size_t i = 1; i < queues.size(); i++)
+        {
+            auto& q = queues[(thief + i) % queues.size()];
+            std::lock_guard lock(q.m);
+            if (q.items.empty())
+                continue;
+            const auto item = q.items.front();
+            q.items.pop_front();
+            return item;
+        }
+        return std::nullopt;
+    }
+
+    void workerLoop(unsigned worker)
+    {
+        unsigned long seenGeneration = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock lock(stateMutex);
+                wakeCv.wait(lock, [&] { return stop || generation != seenGeneration; });
+                if (stop)
+                    return;
+                seenGeneration = generation;
+            }
+
+            for (;;)
+            {
+                auto item = popLocal(worker);
+                if (!item)
+                    item = steal(worker);
+                if (!item)
+                    break;
+
+                const auto [task, index] = *item;
+                (*task)(index, worker);
+                if (--pending == 0)
+                {
+                    std::lock_guard lock(stateMutex);
+                    doneCv.notify_all();
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,135 @@
+#include "npgr026.h"
+
+#include "Spectrum.h"
+#include "ColorSpace.h"
+#include "ColorTargets.h"
+#include "Sampler.h"
+#include "Quadrature.h"
+#include "Polarization.h"
+#include "Scene.h"
+
+static_assert(NPGR_LAMBDA_LOW == Spectrum::VisibleFull::LAMBDA_LOW);
+static_assert(NPGR_SPECTRUM_SAMPLES == Spectrum::VisibleFull::LAMBDA_RANGE);
+static_assert(NPGR_TARGET_SRGB == static_cast<int>(ColorSpace::TargetId::eSRGB));
+static_assert(NPGR_TARGET_REC2020 == static_cast<int>(ColorSpace::TargetId::eRec2020));
+static_assert(NPGR_TARGET_ACESCG == static_cast<int>(ColorSpace::TargetId::eACEScg));
+static_assert(NPGR_TARGET_DISPLAY_P3 == static_cast<int>(ColorSpace::TargetId::eDisplayP3));
+static_assert(NPGR_TARGET_XYZ == static_cast<int>(ColorSpace::TargetId::eXYZ));
+
+namespace
+{
+    constexpr auto TARGET_COUNT = static_cast<std::size_t>(ColorSpace::TargetId::eCount);
+
+    std::vector<ColorSpace::TargetId> allTargets()
+    {
+        std::vector<ColorSpace::TargetId> ids;
+        for (std::size_t t = 0; t < TARGET_COUNT; t++)
+            ids.push_back(static_cast<ColorSpace::TargetId>(t));
+        return ids;
+    }
+
+    // built at load time, projecting into every target costs one sweep regardless of how many are requested
+    const ColorSpace::SpectralBasis BASIS_ADAPTED(allTargets(), true);
+    const ColorSpace::SpectralBasis BASIS_PLAIN(allTargets(), false);
+
+    void store(const glm::vec3& v, float* out)
+    {
+        out[0] = v.x;
+        out[1] = v.y;
+        out[2] = v.z;
+    }
+
+    bool valid(const npgr_sampling& s)
+    {
+        if (s.sampler == NPGR_SAMPLER_FULL)
+            return true;
+        return s.sampler >= NPGR_SAMPLER_UNIFORM && s.sampler <= NPGR_SAMPLER_ADAPTIVE && s.sample_count >= 1;
+    }
+
+    glm::vec3 evaluateXYZ(const npgr_sampling& s, const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material)
+    {
+        switch (s.sampler)
+        {
+            case NPGR_SAMPLER_UNIFORM:
+                return ColorSpace::XYZ(Sampler::Uniform(s.seed).eval(s.sample_count, luminary, material)).color;
+            case NPGR_SAMPLER_HERO:
+                return ColorSpace::XYZ(Sampler::Hero<>(s.seed).eval(s.sample_count, luminary, material)).color;
+            case NPGR_SAMPLER_MIDPOINT:
+                return Quadrature::xyz(Quadrature::Method::eMidpoint, s.sample_count, luminary, material);
+            case NPGR_SAMPLER_SIMPSON:
+                return Quadrature::xyz(Quadrature::Method::eSimpson, s.sample_count, luminary, material);
+            case NPGR_SAMPLER_GAUSS_LEGENDRE:
+                return Quadrature::xyz(Quadrature::Method::eGaussLegendre, s.sample_count, luminary, material);
+            case NPGR_SAMPLER_ADAPTIVE:
+                return Quadrature::xyz(Quadrature::Method::eAdaptive, s.sample_count, luminary, material);
+            default:
+                return ColorSpace::XYZ(luminary * material).color;
+        }
+    }
+}
+
+void npgr_spectra_to_xyz(const float* spectra, size_t count, float* xyz)
+{
+    for (size_t i = 0; i < count; i++)
+        store(ColorSpace::XYZ(Spectrum::VisibleFull(spectra + i * NPGR_SPECTRUM_SAMPLES)).color, xyz + i * 3);
+}
+
+void npgr_spectra_to_rgb(const float* spectra, size_t count, float* rgb)
+{
+    for (size_t i = 0; i < count; i++)
+        store(ColorSpace::RGB(Spectrum::VisibleFull(spectra + i * NPGR_SPECTRUM_SAMPLES)).color, rgb + i * 3);
+}
+
+npgr_status npgr_spectra_to_targets(const float* spectra, size_t count,
+                                    const npgr_color_target* targets, size_t target_count,
+                                    int chromatic_adaptation, float* out)
+{
+    for (size_t t = 0; t < target_count; t++)
+        if (targets[t] < 0 || static_cast<std::size_t>(targets[t]) >= TARGET_COUNT)
+            return NPGR_ERROR_INVALID_ARGUMENT;
+
+    const auto& basis = chromatic_adaptation ? BASIS_ADAPTED : BASIS_PLAIN;
+    float channels[3 * TARGET_COUNT];
+    for (size_t i = 0; i < count; i++)
+    {
+        basis.project(Spectrum::VisibleFull(spectra + i * NPGR_SPECTRUM_SAMPLES), channels);
+        for (size_t t = 0; t < target_count; t++)
+            for (auto c = 0; c < 3; c++)
+                out[(i * target_count + t) * 3 + c] = channels[3 * targets[t] + c];
+    }
+    return NPGR_OK;
+}
+
+npgr_status npgr_multiply_to_rgb(const float* luminaries, size_t luminary_count,
+                                 const float* materials, size_t material_count,
+                                 const npgr_sampling* sampling, float* rgb)
+{
+    if (!sampling || !valid(*sampling))
+        return NPGR_ERROR_INVALID_ARGUMENT;
+    for (size_t l = 0; l < luminary_count; l++)
+    {
+        const Spectrum::VisibleFull luminary(luminaries + l * NPGR_SPECTRUM_SAMPLES);
+        for (size_t m = 0; m < material_count; m++)
+        {
+            const Spectrum::VisibleFull material(materials + m * NPGR_SPECTRUM_SAMPLES);
+            store(ColorSpace::RGB(ColorSpace::XYZ(evaluateXYZ(*sampling, luminary, material))).color, rgb + (l * material_count + m) * 3);
+        }
+    }
+    return NPGR_OK;
+}
+
+void npgr_traverse_scenes(const npgr_scene* scenes, size_t count, const float* light, float* stokes)
+{
+    const Scene::StokesVec lightSv(light[0], light[1], light[2], light[3]);
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto& s = scenes[i];
+        const Scene::FresnelSurface x1{ s.x1.theta, s.x1.eta, s.x1.eta_k };
+        const Scene::FresnelSurface x2{ s.x2.theta, s.x2.eta, s.x2.eta_k };
+        const Scene::Scene scene(static_cast<short>(i), x1, x2, s.has_filter != 0, s.filter_rot, s.rho);
+
+        const auto sv = scene.traverse(lightSv).sv;
+        for (auto c = 0; c < 4; c++)
+            stokes[i * 4 + c] = sv[c];
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+ * Embeddable batch API for the spectrum and polarization models.
+ *
+ * All buffers are owned by the caller. No function prints or touches global stream state, and the library is
+ * built without the profiler. The only allocation is a quadrature rule built the first time its sampler and
+ * sample_count are used; it is kept for the lifetime of the process and later calls only read it.
+ * The color matching tables are built once when the library is loaded and are read-only afterwards,
+ * every function is reentrant and may be called concurrently from any number of threads
+ * as long as the output buffers do not overlap.
+ * Functions taking parameters that can be out of range return a status and leave the output untouched on error.
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(NPGR_SHARED_BUILD)
+#define NPGR_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(NPGR_SHARED)
+#define NPGR_API __declspec(dllimport)
+#elif defined(__GNUC__)
+#define NPGR_API __attribute__((visibility("default")))
+#else
+#define NPGR_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* spectra are dense arrays of NPGR_SPECTRUM_SAMPLES values at 1 nm steps starting at NPGR_LAMBDA_LOW */
+#define NPGR_LAMBDA_LOW 380
+#define NPGR_SPECTRUM_SAMPLES 351
+
+typedef enum npgr_status
+{
+    NPGR_OK = 0,
+    NPGR_ERROR_INVALID_ARGUMENT = 1
+} npgr_status;
+
+typedef enum npgr_sampler
+{
+    NPGR_SAMPLER_FULL = 0,
+    NPGR_SAMPLER_UNIFORM = 1,
+    NPGR_SAMPLER_HERO = 2,
+    /* midpoint quadrature, kept under its old name */
+    NPGR_SAMPLER_EQUIDISTANT = 3,
+    NPGR_SAMPLER_MIDPOINT = 3,
+    NPGR_SAMPLER_SIMPSON = 4,
+    NPGR_SAMPLER_GAUSS_LEGENDRE = 5,
+    /* sample_count caps the number of evaluations, at least 5 are made */
+    NPGR_SAMPLER_ADAPTIVE = 6
+} npgr_sampler;
+
+typedef struct npgr_sampling
+{
+    npgr_sampler sampler;
+    /* ignored by NPGR_SAMPLER_FULL, at least 1 otherwise; hero draws evaluate one wavelength per SIMD lane each,
+     * fixed quadrature rules use at most NPGR_SPECTRUM_SAMPLES nodes */
+    int sample_count;
+    /* random samplers restart from this seed for every luminary x material pair */
+    unsigned seed;
+} npgr_sampling;
+
+typedef enum npgr_color_target
+{
+    NPGR_TARGET_SRGB = 0,
+    NPGR_TARGET_REC2020 = 1,
+    NPGR_TARGET_ACESCG = 2,
+    NPGR_TARGET_DISPLAY_P3 = 3,
+    NPGR_TARGET_XYZ = 4
+} npgr_color_target;
+
+typedef struct npgr_surface
+{
+    /* angle of incidence in degrees */
+    float theta;
+    float eta;
+    float eta_k;
+} npgr_surface;
+
+typedef struct npgr_scene
+{
+    npgr_surface x1;
+    npgr_surface x2;
+    /* rotation of the second interface in degrees */
+    float rho;
+    int has_filter;
+    /* linear filter rotation in degrees */
+    float filter_rot;
+} npgr_scene;
+
+/* xyz: count * 3 floats */
+NPGR_API void npgr_spectra_to_xyz(const float* spectra, size_t count, float* xyz);
+
+/* rgb: count * 3 floats, linear sRGB */
+NPGR_API void npgr_spectra_to_rgb(const float* spectra, size_t count, float* rgb);
+
+/* out: count * target_count * 3 floats, spectrum i in target t at index (i * target_count + t) * 3
+ * all targets come from a single pass over each spectrum, chromatic_adaptation != 0 adapts D65 to the target white
+ * NPGR_ERROR_INVALID_ARGUMENT if any target is not an npgr_color_target value */
+NPGR_API npgr_status npgr_spectra_to_targets(const float* spectra, size_t count,
+                                             const npgr_color_target* targets, size_t target_count,
+                                             int chromatic_adaptation, float* out);
+
+/* rgb: luminary_count * material_count * 3 floats, pair (l, m) at index (l * material_count + m) * 3
+ * NPGR_ERROR_INVALID_ARGUMENT for an unknown sampler or a sample_count below 1 */
+NPGR_API npgr_status npgr_multiply_to_rgb(const float* luminaries, size_t luminary_count,
+                                          const float* materials, size_t material_count,
+                                          const npgr_sampling* sampling, float* rgb);
+
+/* light: input Stokes vector (4 floats), stokes: count * 4 floats */
+NPGR_API void npgr_traverse_scenes(const npgr_scene* scenes, size_t count, const float* light, float* stokes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+// forward-mode automatic differentiation: a value with its partial derivatives along N seeded directions
+// converts implicitly from plain numbers, so the templated Fresnel and Mueller code runs on it unchanged
+template<typename T, int N>
+struct Dual
+{
+    T v = T(0);
+    std::array<T, N> d{};
+
+    Dual() = default;
+    Dual(T value) : v(value) {}
+
+    // independent variable i
+    static Dual variable(T value, int i)
+    {
+        Dual x(value);
+        x.d[i] = T(1);
+        return x;
+    }
+
+    Dual& operator+=(const Dual& rhs)
+    {
+        v += rhs.v;
+        for (auto i = 0; i < N; i++)
+            d[i] += rhs.d[i];
+        return *this;
+    }
+
+    Dual& operator-=(const Dual& rhs)
+    {
+        v -= rhs.v;
+        for (auto i = 0; i < N; i++)
+            d[i] -= rhs.d[i];
+        return *this;
+    }
+
+    Dual& operator*=(const Dual& rhs)
+    {
+        for (auto i = 0; i < N; i++)
+            d[i] = d[i] * rhs.v + v * rhs.d[i];
+        v *= rhs.v;
+        return *this;
+    }
+
+    Dual& operator/=(const Dual& rhs)
+    {
+        const auto inv = T(1) / rhs.v;
+        v *= inv;
+        for (auto i = 0; i < N; i++)
+            d[i] = (d[i] - v * rhs.d[i]) * inv;
+        return *this;
+    }
+
+    friend Dual operator+(Dual lhs, const Dual& rhs) { return lhs += rhs; }
+    friend Dual operator-(Dual lhs, const Dual& rhs) { return lhs -= rhs; }
+    friend Dual operator*(Dual lhs, const Dual& rhs) { return lhs *= rhs; }
+    friend Dual operator/(Dual lhs, const Dual& rhs) { return lhs /= rhs; }
+
+    friend Dual operator-(const Dual& x)
+    {
+        return chain(x, -x.v, T(-1));
+    }
+
+    // comparisons look at the value only
+    friend bool operator<(const Dual& a, const Dual& b) { return a.v < b.v; }
+    friend bool operator>(const Dual& a, const Dual& b) { return a.v > b.v; }
+    friend bool operator==(const Dual& a, const Dual& b) { return a.v == b.v; }
+    friend bool operator!=(const Dual& a, const Dual& b) { return a.v != b.v; }
+
+    friend Dual sqrt(const Dual& x)
+    {
+        using std::sqrt;
+        const auto s = sqrt(x.v);
+        // the clamped terms of the general Fresnel case hit 0, treat the derivative there as 0
+        return chain(x, s, s > T(0) ? T(0.5) / s : T(0));
+    }
+
+    friend Dual sin(const Dual& x)
+    {
+        using std::sin;
+        using std::cos;
+        return chain(x, sin(x.v), cos(x.v));
+    }
+
+    friend Dual cos(const Dual& x)
+    {
+        using std::sin;
+        using std::cos;
+        return chain(x, cos(x.v), -sin(x.v));
+    }
+
+    friend Dual atan2(const Dual& y, const Dual& x)
+    {
+        using std::atan2;
+        Dual r(atan2(y.v, x.v));
+        const auto inv = T(1) / (x.v * x.v + y.v * y.v);
+        for (auto i = 0; i < N; i++)
+            r.d[i] = (x.v * y.d[i] - y.v * x.d[i]) * inv;
+        return r;
+    }
+
+    friend Dual max(const Dual& a, const Dual& b)
+    {
+        return a.v < b.v ? b : a;
+    }
+
+private:
+    // f(x) with f'(x) = slope
+    static Dual chain(const Dual& x, T value, T slope)
+    {
+        Dual r(value);
+        for (auto i = 0; i < N; i++)
+            r.d[i] = x.d[i] * slope;
+        return r;
+    }
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "Polarization.h"
+#include "Dual.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+// inverse problem: recover the surface parameters of a single reflection from measured Stokes vectors
+// model: s_out = Rotate(FresnelReflectance(cos(theta), eta, etaK), rho) * s_in, angles in degrees as in Scene::FresnelSurface
+namespace Fit
+{
+    enum Parameter
+    {
+        eEta,
+        eEtaK,
+        eTheta,
+        eRho,
+        PARAMETER_COUNT
+    };
+
+    using Params = std::array<double, PARAMETER_COUNT>;
+    using Stokes = std::array<double, 4>;
+
+    struct Observation
+    {
+        // incident light, unpolarized by default like Scene::Scene
+        Stokes in{ 100.0, 0.0, 0.0, 0.0 };
+        Stokes out{};
+    };
+
+    // one pixel, all observations share the surface parameters
+    // a single unpolarized observation does not constrain the retardance, several incident states make the fit well posed
+    struct Sample
+    {
+        int id = 0;
+        std::vector<Observation> observations;
+    };
+
+    struct Options
+    {
+        Params initial{ 1.5, 0.0, 45.0, 0.0 };
+        // fixed parameters keep their initial value, e.g. a known viewing geometry
+        std::array<bool, PARAMETER_COUNT> fixed{};
+        int maxIterations = 100;
+        double tolerance = 1e-10;
+        // fits ending above this rms residual are restarted from a coarse grid of starting points, the best one is kept
+        double restartRms = 1e-3;
+        unsigned threads = 0;
+    };
+
+    struct Solution
+    {
+        int id = 0;
+        Params params{};
+        // root mean square Stokes residual
+        double rms = 0.0;
+        int iterations = 0;
+        bool converged = false;
+    };
+
+    template<typename T>
+    std::array<T, 4> model(const std::array<T, PARAMETER_COUNT>& p, const Stokes& in)
+    {
+        using std::cos;
+        const auto degToRad = T(static_cast<double>(M_PI) / 180.0);
+        const auto fresnel = MuellerMatrix::FresnelReflectance(Fresnel<FresnelType::eGeneral, T>(cos(p[eTheta] * degToRad), p[eEta], p[eEtaK]));
+        const auto mm = MuellerMatrix::Rotate(fresnel, p[eRho] * degToRad);
+
+        std::array<T, 4> out;
+        for (auto r = 0; r < 4; r++)
+        {
+            out[r] = T(0.0);
+            for (auto c = 0; c < 4; c++)
+                out[r] += mm[c][r] * T(in[c]);
+        }
+        return out;
+    }
+
+    // Levenberg-Marquardt on the normal equations, the Jacobian comes from one dual-number pass per observation
+    class Solver
+    {
+    public:
+        explicit Solver(const Options& options) : options(options) {}
+
+        [[nodiscard]] Solution solve(const Sample& sample) const
+        {
+            auto best = solve(sample, options.initial);
+            if (best.rms <= options.restartRms)
+                return best;
+
+            // the Fresnel terms are far from convex in theta and etaK
+            for (const auto eta : { 0.5, 1.5 })
+                for (const auto etaK : { 0.0, 1.0, 3.0 })
+                    for (const auto theta : { 15.0, 35.0, 55.0, 75.0 })
+                    {
+                        auto start = options.initial;
+                        const Params grid{ eta, etaK, theta, options.initial[eRho] };
+                        for (auto i = 0; i < eRho; i++)
+                            if (!options.fixed[i])
+                                start[i] = grid[i];
+                        auto s = solve(sample, start);
+                        // iterations over all starts
+                        s.iterations += best.iterations;
+                        if (s.rms < best.rms)
+                            best = s;
+                        else
+                            best.iterations = s.iterations;
+                        if (best.rms <= options.restartRms)
+                            return best;
+                    }
+            return best;
+        }
+
+        // samples are independent, they are spread over a work-stealing pool in chunks
+        [[nodiscard]] std::vector<Solution> solve(const std::vector<Sample>& samples) const
+        {
+            std::vector<Solution> solutions(samples.size());
+            constexpr int CHUNK = 64;
+            const auto chunks = static_cast<int>((samples.size() + CHUNK - 1) / CHUNK);
+            ThreadPool pool(options.threads);
+            pool.parallelFor(chunks, [&](int chunk, unsigned)
+            {
+                PROFILE_SCOPE("fit.chunk");
+                const auto begin = static_cast<std::size_t>(chunk) * CHUNK;
+                const auto end = std::min(samples.size(), begin + CHUNK);
+                for (auto i = begin; i < end; i++)
+                    solutions[i] = solve(samples[i]);
+                PROFILE_COUNT("fit.chunk", end - begin);
+            });
+            return solutions;
+        }
+
+    private:
+        using D = Dual<double, PARAMETER_COUNT>;
+        using Matrix = std::array<Params, PARAMETER_COUNT>;
+
+        Options options;
+
+        // single Levenberg-Marquardt run from start
+        [[nodiscard]] Solution solve(const Sample& sample, const Params& start) const
+        {
+            Solution s;
+            s.id = sample.id;
+            s.params = start;
+            auto lambda = 1e-3;
+
+            Matrix jtj;
+            Params jtr;
+            auto cost = linearize(sample, s.params, jtj, jtr);
+            for (s.iterations = 0; s.iterations < options.maxIterations; s.iterations++)
+            {
+                // damp until a step lowers the cost
+                auto improved = false;
+                while (!improved && lambda < 1e12)
+                {
+                    auto damped = jtj;
+                    for (auto i = 0; i < PARAMETER_COUNT; i++)
+                        damped[i][i] += lambda * std::max(jtj[i][i], 1e-12);
+                    const auto step = solveSpd(damped, jtr);
+
+                    auto trial = s.params;
+                    for (auto i = 0; i < PARAMETER_COUNT; i++)
+                        trial[i] -= step[i];
+                    project(trial);
+
+                    const auto trialCost = residualCost(sample, trial);
+                    if (trialCost < cost)
+                    {
+                        const auto decrease = cost - trialCost;
+                        s.params = trial;
+                        cost = linearize(sample, s.params, jtj, jtr);
+                        lambda = std::max(lambda * 0.1, 1e-12);
+                        improved = true;
+                        if (decrease <= options.tolerance * (1.0 + cost))
+                            s.converged = true;
+                    }
+                    else
+                        lambda *= 10.0;
+                }
+                // damping hitting its ceiling without a better step is a stall, not a fit
+                if (!improved || s.converged)
+                    break;
+            }
+            s.rms = std::sqrt(2.0 * cost / static_cast<double>(4 * std::max<std::size_t>(1, sample.observations.size())));
+            return s;
+        }
+
+        // 0.5 * sum of squared residuals, J^T J and J^T r at p
+        double linearize(const Sample& sample, const Params& p, Matrix& jtj, Params& jtr) const
+        {
+            std::array<D, PARAMETER_COUNT> x;
+            for (auto i = 0; i < PARAMETER_COUNT; i++)
+                x[i] = options.fixed[i] ? D(p[i]) : D::variable(p[i], i);
+
+            jtj = {};
+            jtr = {};
+            auto cost = 0.0;
+            for (const auto& o : sample.observations)
+            {
+                const auto out = model(x, o.in);
+                for (auto k = 0; k < 4; k++)
+                {
+                    const auto r = out[k].v - o.out[k];
+                    cost += 0.5 * r * r;
+                    for (auto i = 0; i < PARAMETER_COUNT; i++)
+                    {
+                        jtr[i] += out[k].d[i] * r;
+                        for (auto j = 0; j <= i; j++)
+                            jtj[i][j] += out[k].d[i] * out[k].d[j];
+                    }
+                }
+            }
+            for (auto i = 0; i < PARAMETER_COUNT; i++)
+                for (auto j = 0; j < i; j++)
+                    jtj[j][i] = jtj[i][j];
+            return cost;
+        }
+
+        static double residualCost(const Sample& sample, const Params& p)
+        {
+            auto cost = 0.0;
+            for (const auto& o : sample.observations)
+            {
+                const auto out = model(p, o.in);
+                for (auto k = 0; k < 4; k++)
+                    cost += 0.5 * (out[k] - o.out[k]) * (out[k] - o.out[k]);
+            }
+            return cost;
+        }
+
+        // keep the parameters physical
+        static void project(Params& p)
+        {
+            p[eEta] = std::max(p[eEta], 1e-3);
+            p[eEtaK] = std::max(p[eEtaK], 0.0);
+            p[eTheta] = std::clamp(p[eTheta], 0.0, 89.9);
+        }
+
+        // Cholesky solve of a small symmetric positive definite system, fixed parameters have zero rows and get a zero step
+        static Params solveSpd(Matrix a, Params b)
+        {
+            for (auto i = 0; i < PARAMETER_COUNT; i++)
+            {
+                for (auto k = 0; k < i; k++)
+                    a[i][i] -= a[i][k] * a[i][k];
+                a[i][i] = std::sqrt(std::max(a[i][i], 1e-300));
+                for (auto j = i + 1; j < PARAMETER_COUNT; j++)
+                {
+                    for (auto k = 0; k < i; k++)
+                        a[j][i] -= a[j][k] * a[i][k];
+                    a[j][i] /= a[i][i];
+                }
+            }
+            for (auto i = 0; i < PARAMETER_COUNT; i++)
+            {
+                for (auto k = 0; k < i; k++)
+                    b[i] -= a[i][k] * b[k];
+                b[i] /= a[i][i];
+            }
+            for (auto i = PARAMETER_COUNT - 1; i >= 0; i--)
+            {
+                for (auto k = i + 1; k < PARAMETER_COUNT; k++)
+                    b[i] -= a[k][i] * b[k];
+                b[i] /= a[i][i];
+            }
+            return b;
+        }
+    };
+}
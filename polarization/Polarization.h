@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <glm/mat4x4.hpp>
 #include <glm/gtx/string_cast.hpp>
@@ -9,28 +10,106 @@ constexpr float M_PI = 3.14159265358979323846f;
 constexpr float DEG_TO_RAD = 0.017453293f;
 constexpr float RAD_TO_DEG = 57.29577951f;
 
-class FresnelGeneral
+enum class FresnelType
+{
+    // real index of refraction (etaK == 0), reduces to the real Fresnel equations plus a TIR branch
+    eDielectric,
+    // complex index of refraction with etaK > 0, never clamps the intermediate terms
+    eConductor,
+    // full complex formulation, safe for any input
+    eGeneral
+};
+
+// pick the cheapest specialization valid for the material, anything outside both (negative or NaN etaK) takes the general path
+constexpr FresnelType classifyFresnel(float etaK)
+{
+    if (etaK == 0.0f)
+        return FresnelType::eDielectric;
+    if (etaK > 0.0f)
+        return FresnelType::eConductor;
+    return FresnelType::eGeneral;
+}
+
+template<FresnelType Type, typename T = float>
+class Fresnel
 {
 public:
     // reflectance
-    float r_s;
-    float r_p;
+    T r_s;
+    T r_p;
     // retardance
-    float delta_s;
-    float delta_p;
+    T delta_s;
+    T delta_p;
+    // set only by dielectrics, otherwise the retardance is either 0 or pi
+    bool totalInternalReflection = false;
+
+    Fresnel(T cosTheta, T eta, T etaK = T(0))
+    {
+        if constexpr (Type == FresnelType::eDielectric)
+            dielectric(cosTheta, eta);
+        else
+            complex(cosTheta, eta, etaK);
+    }
 
-    FresnelGeneral(float cosTheta, float eta, float etaK)
+private:
+    void dielectric(T cosTheta, T eta)
     {
+        using std::sqrt;
+        using std::atan2;
         const auto cosThetaSqr = cosTheta * cosTheta;
-        const auto sinThetaSqr = 1.0f - cosThetaSqr;
+        const auto sinThetaSqr = T(1) - cosThetaSqr;
+        const auto etaSqr = eta * eta;
+
+        // same terms as the complex case with etaK = 0: t1 = |t0|, either a or b vanishes
+        const auto t0 = etaSqr - sinThetaSqr;
+        if (t0 < T(0))
+        {
+            totalInternalReflection = true;
+            const auto t1 = -t0;
+            const auto b = sqrt(t1);
+            r_s = T(1);
+            r_p = T(1);
+            delta_s = atan2(2 * b * cosTheta, cosThetaSqr - t1);
+            delta_p = atan2(2 * cosTheta * etaSqr * b, etaSqr * etaSqr * cosThetaSqr - t1);
+            return;
+        }
+
+        const auto t1 = t0;
+        const auto a = sqrt(t0);
+        const auto t2 = t1 + cosThetaSqr;
+        const auto t3 = 2 * a * cosTheta;
+        const auto t4 = cosThetaSqr * t1 + sinThetaSqr * sinThetaSqr;
+        const auto t5 = t3 * sinThetaSqr;
+
+        r_s = (t2 - t3) / (t2 + t3);
+        r_p = (t4 - t5) / (t4 + t5) * r_s;
+        // atan2(0, x) without the call
+        const auto pi = static_cast<T>(M_PI);
+        delta_s = cosThetaSqr - t1 < T(0) ? pi : T(0);
+        delta_p = etaSqr * etaSqr * cosThetaSqr - t1 < T(0) ? pi : T(0);
+    }
+
+    void complex(T cosTheta, T eta, T etaK)
+    {
+        using std::sqrt;
+        using std::atan2;
+        using std::max;
+        const auto cosThetaSqr = cosTheta * cosTheta;
+        const auto sinThetaSqr = T(1) - cosThetaSqr;
         const auto etaSqr = eta * eta;
         const auto etaKSqr = etaK * etaK;
 
         const auto t0 = etaSqr - etaKSqr - sinThetaSqr;
         const auto t1 = sqrt(t0 * t0 + 4 * etaSqr * etaKSqr);
 
-        const auto aSqr = std::max(0.0f, static_cast<float>((t1 + t0) * 0.5f));
-        const auto bSqr = std::max(0.0f, static_cast<float>((t1 - t0) * 0.5f));
+        // t1 > |t0| whenever etaK > 0, the clamps only guard the general case against rounding
+        T aSqr = (t1 + t0) * T(0.5);
+        T bSqr = (t1 - t0) * T(0.5);
+        if constexpr (Type == FresnelType::eGeneral)
+        {
+            aSqr = max(T(0), aSqr);
+            bSqr = max(T(0), bSqr);
+        }
         const auto a = sqrt(aSqr);
         const auto b = sqrt(bSqr);
 
@@ -49,64 +128,103 @@ public:
     }
 };
 
+using FresnelGeneral = Fresnel<FresnelType::eGeneral>;
+
 namespace MuellerMatrix
 {
-    static glm::mat4 PlainAttenuation(float attenuationFactor = 1.0f)
+    template<typename T>
+    using Mat = glm::mat<4, 4, T>;
+
+    template<typename T = float>
+    static Mat<T> PlainAttenuation(T attenuationFactor = T(1))
     {
-        glm::mat4 m = {};
+        Mat<T> m = {};
         m[0][0] = m[1][1] = m[2][2] = m[3][3] = attenuationFactor;
         return m;
     }
 
-    static glm::mat4 Depolarizer(float attenuationFactor = 1.0f)
+    template<typename T = float>
+    static Mat<T> Depolarizer(T attenuationFactor = T(1))
     {
-        glm::mat4 m = {};
+        Mat<T> m = {};
         m[0][0] = attenuationFactor;
         return m;
     }
 
-    static glm::mat4 LinearFilter(const float phi = 0.0f)
+    template<typename T = float>
+    static Mat<T> LinearFilter(const T phi = T(0))
     {
+        using std::cos;
+        using std::sin;
         const auto a = 2 * phi;
         const auto cosA = cos(a);
         const auto sinA = sin(a);
 
-        return 0.5f * glm::mat4(
-            1.0f, cosA, sinA, 0.0f,
-            cosA, cosA * cosA, sinA * cosA, 0.0f,
-            sinA, sinA * cosA, sinA * sinA, 0.0f,
-            0.0f, 0.0f, 0.0f, 0.0f);
+        return T(0.5) * Mat<T>(
+            T(1), cosA, sinA, T(0),
+            cosA, cosA * cosA, sinA * cosA, T(0),
+            sinA, sinA * cosA, sinA * sinA, T(0),
+            T(0), T(0), T(0), T(0));
     }
 
-    static glm::mat4 FresnelReflectance(const FresnelGeneral& f)
+    template<FresnelType Type, typename T>
+    static Mat<T> FresnelReflectance(const Fresnel<Type, T>& f)
     {
-        const auto A = (f.r_s + f.r_p) * 0.5f;
-        const auto B = (f.r_s - f.r_p) * 0.5f;
-
-        const auto delta = f.delta_s - f.delta_p;
+        using std::sqrt;
+        using std::cos;
+        using std::sin;
+        const auto A = (f.r_s + f.r_p) * T(0.5);
+        const auto B = (f.r_s - f.r_p) * T(0.5);
         const auto t = sqrt(f.r_s * f.r_p);
 
-        const auto C = cos(delta) * t;
-        const auto S = sin(delta) * t;
+        auto C = t;
+        auto S = T(0);
+        if (Type != FresnelType::eDielectric || f.totalInternalReflection)
+        {
+            const auto delta = f.delta_s - f.delta_p;
+            C = cos(delta) * t;
+            S = sin(delta) * t;
+        }
+        else if (f.delta_s != f.delta_p)
+            // dielectric without TIR, the retardance difference is +-pi
+            C = -t;
+
+        return Mat<T>(
+            A, B, T(0), T(0),
+            B, A, T(0), T(0),
+            T(0), T(0), C, S,
+            T(0), T(0), -S, C);
+    }
 
-        return glm::mat4(
-            A, B, 0.0f, 0.0f,
-            B, A, 0.0f, 0.0f,
-            0.0f, 0.0f, C, S,
-            0.0f, 0.0f, -S, C);
+    // dispatch on a type from classifyFresnel
+    template<typename T = float>
+    static Mat<T> FresnelReflectance(FresnelType type, T cosTheta, T eta, T etaK)
+    {
+        switch (type)
+        {
+            case FresnelType::eDielectric:
+                return FresnelReflectance(Fresnel<FresnelType::eDielectric, T>(cosTheta, eta));
+            case FresnelType::eConductor:
+                return FresnelReflectance(Fresnel<FresnelType::eConductor, T>(cosTheta, eta, etaK));
+            default:
+                return FresnelReflectance(Fresnel<FresnelType::eGeneral, T>(cosTheta, eta, etaK));
+        }
     }
 
     // optimized rotation (simplified matrix multiplication)
     // based on https://nvlpubs.nist.gov/nistpubs/Legacy/TN/nbstechnicalnote910-3.pdf equation 6.39 (page 37)
-    static glm::mat4 Rotate(const glm::mat4& mm, float phi)
+    template<typename T>
+    static Mat<T> Rotate(const Mat<T>& mm, T phi)
     {
+        using std::cos;
+        using std::sin;
         const auto S = sin(2 * phi);
         const auto C = cos(2 * phi);
 
         const auto A = (mm[1][1] - mm[2][2]) * S * S + (mm[2][1] + mm[1][2]) * S * C;
         const auto B = (mm[1][1] - mm[2][2]) * S * C + (mm[2][1] + mm[1][2]) * S * S;
 
-        return glm::mat4(
+        return Mat<T>(
             mm[0][0],                    mm[1][0] * C - mm[2][0] * S, mm[1][0] * S + mm[2][0] * C, mm[3][0],
             mm[0][1] * C - mm[0][2] * S, mm[1][1] - A,                mm[2][1] + B,                mm[3][1] * C - mm[3][2] * S,
             mm[0][1] * S + mm[0][2] * C, mm[1][2] + B,                mm[2][2] + A,                mm[3][1] * S + mm[3][2] * C,
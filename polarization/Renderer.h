@@ -0,0 +1,305 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include "Polarization.h"
+#include "Scene.h"
+#include "ImageIO.h"
+#include "ThreadPool.h"
+
+namespace Render
+{
+    using vec3 = glm::vec3;
+
+    struct Ray
+    {
+        vec3 origin;
+        vec3 dir;
+        // Stokes reference axis, kept perpendicular to dir
+        vec3 frameX;
+    };
+
+    struct Material
+    {
+        float eta = 1.0f;
+
+        Material(float eta = 1.0f, float etaK = 0.0f) : eta(eta), kappa(etaK), type(classifyFresnel(etaK)) {}
+
+        [[nodiscard]] float etaK() const { return kappa; }
+        [[nodiscard]] FresnelType fresnelType() const { return type; }
+
+        // reclassifies, the renderer dispatches on the stored type
+        void setEtaK(float etaK)
+        {
+            kappa = etaK;
+            type = classifyFresnel(etaK);
+        }
+
+    private:
+        float kappa;
+        FresnelType type;
+    };
+
+    struct Plane
+    {
+        vec3 point;
+        vec3 normal;
+        Material material;
+    };
+
+    struct Sphere
+    {
+        vec3 center;
+        float radius = 1.0f;
+        Material material;
+        // emitted unpolarized radiance, 0 for plain reflectors
+        float emission = 0.0f;
+    };
+
+    // rectangular linear polarizer sheet, rays pass through it
+    struct PolarizingFilter
+    {
+        vec3 center;
+        vec3 normal;
+        vec3 axis;
+        float halfSize = 1.0f;
+    };
+
+    struct Camera
+    {
+        vec3 position{0.0f, 1.0f, 6.0f};
+        vec3 lookAt{0.0f, 0.8f, 0.0f};
+        vec3 up{0.0f, 1.0f, 0.0f};
+        float fovY = 45.0f;
+    };
+
+    struct Settings
+    {
+        int width = 640;
+        int height = 480;
+        int samplesPerPixel = 16;
+        int tileSize = 32;
+        int maxDepth = 4;
+        unsigned threads = 0;
+    };
+
+    struct Stats
+    {
+        double seconds = 0.0;
+        long long samples = 0;
+        unsigned threads = 0;
+
+        void print() const
+        {
+            const auto perSecond = static_cast<double>(samples) / seconds;
+            std::cout << "Rendered " << samples << " samples in " << seconds << " s on " << threads << " threads\n";
+            std::cout << "Throughput: " << perSecond << " samples/s, " << perSecond / threads << " samples/s/core\n";
+        }
+    };
+
+    class AnalyticScene
+    {
+    public:
+        Camera camera;
+        std::vector<Plane> planes;
+        std::vector<Sphere> spheres;
+        std::vector<PolarizingFilter> filters;
+        float skyHorizon = 20.0f;
+        float skyZenith = 100.0f;
+
+        // water ground, glass and gold spheres, a lamp and a polarizer sheet covering part of the view
+        static AnalyticScene demo()
+        {
+            AnalyticScene s;
+            s.planes.push_back({ { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 1.33f, 0.0f } });
+            s.spheres.push_back({ { -1.2f, 1.0f, 0.0f }, 1.0f, { 1.5f, 0.0f } });
+            s.spheres.push_back({ { 1.2f, 1.0f, 0.0f }, 1.0f, { 0.47f, 2.4f } });
+            s.spheres.push_back({ { 0.0f, 6.0f, -6.0f }, 1.5f, {}, 1000.0f });
+            s.filters.push_back({ { 0.8f, 1.0f, 3.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f }, 0.7f });
+            return s;
+        }
+
+        [[nodiscard]] Scene::StokesVec trace(Ray ray, int maxDepth) const
+        {
+            Scene::RayState state;
+            for (auto depth = 0; depth <= maxDepth; depth++)
+            {
+                const auto hit = intersect(ray);
+                if (hit.type == HitType::eNone)
+                    return state.lightInteraction(sky(ray.dir));
+
+                const auto p = ray.origin + ray.dir * hit.t;
+                if (hit.type == HitType::eFilter)
+                {
+                    const auto& f = filters[hit.index];
+                    const auto axis = glm::normalize(f.axis - ray.dir * glm::dot(f.axis, ray.dir));
+                    state.addInterfaceInteraction(MuellerMatrix::LinearFilter(), frameAngle(ray, axis) * RAD_TO_DEG);
+                    ray = { p + ray.dir * EPSILON, ray.dir, axis };
+                    continue;
+                }
+
+                const auto& material = hit.type == HitType::ePlane ? planes[hit.index].material : spheres[hit.index].material;
+                if (hit.type == HitType::eSphere && spheres[hit.index].emission > 0.0f)
+                    return state.lightInteraction({ spheres[hit.index].emission, 0.0f, 0.0f, 0.0f });
+
+                const auto cosTheta = std::min(1.0f, -glm::dot(ray.dir, hit.normal));
+                auto s = glm::cross(ray.dir, hit.normal);
+                const auto sLength = glm::length(s);
+                s = sLength > 1e-6f ? s / sLength : ray.frameX;
+
+                const auto mm = MuellerMatrix::FresnelReflectance(material.fresnelType(), cosTheta, material.eta, material.etaK());
+                state.addInterfaceInteraction(mm, frameAngle(ray, s) * RAD_TO_DEG);
+
+                const auto reflected = glm::reflect(ray.dir, hit.normal);
+                ray = { p + hit.normal * EPSILON, reflected, s };
+            }
+            return {};
+        }
+
+    private:
+        static constexpr float EPSILON = 1e-4f;
+
+        enum class HitType { eNone, ePlane, eSphere, eFilter };
+        struct Hit
+        {
+            HitType type = HitType::eNone;
+            std::size_t index = 0;
+            float t = std::numeric_limits<float>::max();
+            vec3 normal{};
+        };
+
+        [[nodiscard]] Scene::StokesVec sky(const vec3& dir) const
+        {
+            const auto t = std::max(0.0f, dir.y);
+            return { skyHorizon + (skyZenith - skyHorizon) * t, 0.0f, 0.0f, 0.0f };
+        }
+
+        // signed angle rotating the ray frame onto the given axis, counter-clockwise around the ray direction
+        static float frameAngle(const Ray& ray, const vec3& axis)
+        {
+            return std::atan2(glm::dot(glm::cross(ray.frameX, axis), ray.dir), glm::dot(ray.frameX, axis));
+        }
+
+        [[nodiscard]] Hit intersect(const Ray& ray) const
+        {
+            Hit hit;
+            for (std::size_t i = 0; i < planes.size(); i++)
+            {
+                const auto& pl = planes[i];
+                const auto denom = glm::dot(ray.dir, pl.normal);
+                if (denom >= 0.0f)
+                    continue;
+                const auto t = glm::dot(pl.point - ray.origin, pl.normal) / denom;
+                if (t > 0.0f && t < hit.t)
+                    hit = { HitType::ePlane, i, t, pl.normal };
+            }
+            for (std::size_t i = 0; i < spheres.size(); i++)
+            {
+                const auto& sp = spheres[i];
+                const auto oc = ray.origin - sp.center;
+                const auto b = glm::dot(oc, ray.dir);
+                const auto c = glm::dot(oc, oc) - sp.radius * sp.radius;
+                const auto disc = b * b - c;
+                if (disc < 0.0f)
+                    continue;
+                const auto t = -b - std::sqrt(disc);
+                if (t > 0.0f && t < hit.t)
+                    hit = { HitType::eSphere, i, t, (oc + ray.dir * t) / sp.radius };
+            }
+            for (std::size_t i = 0; i < filters.size(); i++)
+            {
+                const auto& f = filters[i];
+                const auto denom = glm::dot(ray.dir, f.normal);
+                if (std::abs(denom) < 1e-6f)
+                    continue;
+                const auto t = glm::dot(f.center - ray.origin, f.normal) / denom;
+                if (t <= 0.0f || t >= hit.t)
+                    continue;
+                const auto d = ray.origin + ray.dir * t - f.center;
+                const auto v = glm::cross(f.normal, f.axis);
+                if (std::abs(glm::dot(d, f.axis)) <= f.halfSize && std::abs(glm::dot(d, v)) <= f.halfSize)
+                    hit = { HitType::eFilter, i, t, f.normal };
+            }
+            return hit;
+        }
+    };
+
+    // writes <prefix>_s0.pfm .. <prefix>_s3.pfm, tiles are distributed over a work-stealing pool
+    // and write straight into the memory-mapped outputs
+    class TileRenderer
+    {
+    public:
+        explicit TileRenderer(const Settings& settings) : settings(settings) {}
+
+        Stats render(const AnalyticScene& scene, const std::string& outputPrefix) const
+        {
+            const auto w = settings.width;
+            const auto h = settings.height;
+            ImageIO::PfmImage stokes[4] = {
+                { outputPrefix + "_s0.pfm", w, h },
+                { outputPrefix + "_s1.pfm", w, h },
+                { outputPrefix + "_s2.pfm", w, h },
+                { outputPrefix + "_s3.pfm", w, h } };
+
+            const auto tilesX = (w + settings.tileSize - 1) / settings.tileSize;
+            const auto tilesY = (h + settings.tileSize - 1) / settings.tileSize;
+
+            const auto& cam = scene.camera;
+            const auto forward = glm::normalize(cam.lookAt - cam.position);
+            const auto right = glm::normalize(glm::cross(forward, cam.up));
+            const auto up = glm::cross(right, forward);
+            const auto tanHalf = std::tan(cam.fovY * 0.5f * DEG_TO_RAD);
+            const auto aspect = static_cast<float>(w) / static_cast<float>(h);
+
+            ThreadPool pool(settings.threads);
+            const auto start = std::chrono::steady_clock::now();
+            pool.parallelFor(tilesX * tilesY, [&](int tile, unsigned)
+            {
+                PROFILE_SCOPE("render.tile");
+                // seeded per tile, the image does not depend on scheduling
+                std::mt19937 gen(static_cast<std::mt19937::result_type>(tile));
+                std::uniform_real_distribution<float> jitter(0.0f, 1.0f);
+
+                const auto x0 = (tile % tilesX) * settings.tileSize;
+                const auto y0 = (tile / tilesX) * settings.tileSize;
+                const auto x1 = std::min(x0 + settings.tileSize, w);
+                const auto y1 = std::min(y0 + settings.tileSize, h);
+                for (auto y = y0; y < y1; y++)
+                    for (auto x = x0; x < x1; x++)
+                    {
+                        Scene::StokesVec sum{};
+                        for (auto s = 0; s < settings.samplesPerPixel; s++)
+                        {
+                            const auto u = (2.0f * (x + jitter(gen)) / w - 1.0f) * tanHalf * aspect;
+                            const auto v = (1.0f - 2.0f * (y + jitter(gen)) / h) * tanHalf;
+                            const auto dir = glm::normalize(forward + right * u + up * v);
+                            const auto frameX = glm::normalize(right - dir * glm::dot(right, dir));
+                            sum += scene.trace({ cam.position, dir, frameX }, settings.maxDepth);
+                        }
+                        sum *= 1.0f / static_cast<float>(settings.samplesPerPixel);
+                        for (auto c = 0; c < 4; c++)
+                            stokes[c].at(x, y) = sum[c];
+                    }
+                PROFILE_COUNT("render.tile", (x1 - x0) * (y1 - y0) * settings.samplesPerPixel);
+            });
+            const auto end = std::chrono::steady_clock::now();
+
+            Stats stats;
+            stats.seconds = std::chrono::duration<double>(end - start).count();
+            stats.samples = static_cast<long long>(w) * h * settings.samplesPerPixel;
+            stats.threads = pool.size();
+            return stats;
+        }
+
+    private:
+        Settings settings;
+    };
+}
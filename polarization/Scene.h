@@ -1,5 +1,7 @@
 #pragma once
-#include <memory>
+#include <optional>
+
+#include "Profiler.h"
 
 namespace Scene
 {
@@ -10,12 +12,27 @@ namespace Scene
     {
         float theta = 0.0f;
         float eta = 1.0f;
-        float etaK = 0.0f;
+
+        FresnelSurface(float theta = 0.0f, float eta = 1.0f, float etaK = 0.0f)
+            : theta(theta), eta(eta), kappa(etaK), type(classifyFresnel(etaK)) {}
+
+        [[nodiscard]] float etaK() const { return kappa; }
+
+        // the Fresnel specialization is picked here once, not on every evaluation
+        void setEtaK(float etaK)
+        {
+            kappa = etaK;
+            type = classifyFresnel(etaK);
+        }
 
         [[nodiscard]] MuellerMat getMuellerMatrix() const
         {
-            return MuellerMatrix::FresnelReflectance(FresnelGeneral(cos(theta * DEG_TO_RAD), eta, etaK));
+            return MuellerMatrix::FresnelReflectance(type, std::cos(theta * DEG_TO_RAD), eta, kappa);
         }
+
+    private:
+        float kappa;
+        FresnelType type;
     };
 
     struct LinearFilter
@@ -70,11 +87,17 @@ namespace Scene
         short id = 0;
         FresnelSurface x1, x2;
         float rho = 0.0f;
-        std::unique_ptr<LinearFilter> filter;
+        std::optional<LinearFilter> filter;
 
     public:
         [[nodiscard]] Result traverse() const
         {
+            return traverse(unpolarizedLight);
+        }
+
+        [[nodiscard]] Result traverse(const StokesVec& light) const
+        {
+            PROFILE_SCOPE("scene.traverse");
             RayState compoundMM;
 
             // emulation of light path from camera to source
@@ -83,7 +106,7 @@ namespace Scene
             if (filter)
                 compoundMM.addInterfaceInteraction(filter->getMuellerMatrix());
 
-            return { id, compoundMM.lightInteraction(unpolarizedLight) };
+            return { id, compoundMM.lightInteraction(light) };
         }
 
         static void printHeader()
@@ -94,7 +117,7 @@ namespace Scene
 
         void print() const
         {
-            std::cout << id << '\t' << x1.eta << '\t' << x1.etaK << '\t' << x2.eta << '\t' << x2.etaK << '\t' << x1.theta << '\t' << rho << '\t' << x2.theta << '\t';
+            std::cout << id << '\t' << x1.eta << '\t' << x1.etaK() << '\t' << x2.eta << '\t' << x2.etaK() << '\t' << x1.theta << '\t' << rho << '\t' << x2.theta << '\t';
             if (filter)
                 std::cout << filter->filterRot << "\n";
             else
@@ -105,7 +128,7 @@ namespace Scene
             id(id), x1(x1), x2(x2), rho(rho)
         {
             if (insertFilter)
-                filter = std::make_unique<LinearFilter>(LinearFilter{filterRot});
+                filter = LinearFilter{filterRot};
         }
     };
     StokesVec Scene::unpolarizedLight = { 100.0f, 0.0f, 0.0f, 0.0f };
@@ -1,13 +1,174 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <unordered_map>
 #include <vector>
 
+#include "InputParser.h"
 #include "Polarization.h"
 #include "Scene.h"
+#include "Renderer.h"
+#include "Fit.h"
+
+int render(const InputParser& input)
+{
+    Render::Settings settings;
+    if (const auto o = input.getCmdOption("-x"); !o.empty())
+        settings.width = std::stoi(o);
+    if (const auto o = input.getCmdOption("-y"); !o.empty())
+        settings.height = std::stoi(o);
+    if (const auto o = input.getCmdOption("-s"); !o.empty())
+        settings.samplesPerPixel = std::stoi(o);
+    if (const auto o = input.getCmdOption("-t"); !o.empty())
+        settings.threads = static_cast<unsigned>(std::stoi(o));
+    if (settings.width < 1 || settings.height < 1 || settings.samplesPerPixel < 1)
+    {
+        std::cerr << "width, height and samples per pixel must be at least 1\n";
+        return EXIT_FAILURE;
+    }
+
+    const Render::TileRenderer renderer(settings);
+    const auto stats = renderer.render(Render::AnalyticScene::demo(), input.getCmdOption("--render"));
+    stats.print();
+    return EXIT_SUCCESS;
+}
+
+// measurements, one per line: "id s0 s1 s2 s3" for unpolarized incident light (as printed by Scene::Result)
+// or "id in0 in1 in2 in3 s0 s1 s2 s3", lines sharing an id are fitted together
+// malformed lines are reported with their 1-based line number and skipped
+std::vector<Fit::Sample> readMeasurements(std::istream& in)
+{
+    std::vector<Fit::Sample> samples;
+    std::unordered_map<int, std::size_t> index;
+    std::string line;
+    for (auto lineNumber = 1; std::getline(in, line); lineNumber++)
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ls(line);
+        int id = 0;
+        std::vector<double> values;
+        if (!(ls >> id))
+        {
+            std::cerr << "line " << lineNumber << ": no sample id, skipped\n";
+            continue;
+        }
+        for (double v; ls >> v;)
+            values.push_back(v);
+
+        Fit::Observation o;
+        if (!ls.eof() || (values.size() != 4 && values.size() != 8))
+        {
+            std::cerr << "line " << lineNumber << ": expected 4 or 8 numbers after the id, skipped\n";
+            continue;
+        }
+        if (values.size() == 8)
+            std::copy_n(values.begin(), 4, o.in.begin());
+        std::copy_n(values.end() - 4, 4, o.out.begin());
+
+        const auto [it, inserted] = index.try_emplace(id, samples.size());
+        if (inserted)
+            samples.push_back({ id, {} });
+        samples[it->second].observations.push_back(o);
+    }
+    return samples;
+}
+
+int fit(const InputParser& input)
+{
+    const auto& path = input.getCmdOption("--fit");
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "cannot open " << path << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // options, --fix names and the output header use the same parameter names
+    Fit::Options options;
+    const char* names[] = { "eta", "etaK", "theta", "rho" };
+    for (auto i = 0; i < Fit::PARAMETER_COUNT; i++)
+        if (const auto& o = input.getCmdOption(std::string("--") + names[i]); !o.empty())
+            options.initial[i] = std::stod(o);
+    std::istringstream fixed(input.getCmdOption("--fix"));
+    for (std::string name; std::getline(fixed, name, ',');)
+    {
+        const auto it = std::find(std::begin(names), std::end(names), name);
+        if (it == std::end(names))
+        {
+            std::cerr << "unknown parameter " << name << " in --fix, expected eta, etaK, theta or rho\n";
+            return EXIT_FAILURE;
+        }
+        options.fixed[it - std::begin(names)] = true;
+    }
+    if (const auto o = input.getCmdOption("-t"); !o.empty())
+        options.threads = static_cast<unsigned>(std::stoi(o));
+
+    const auto samples = readMeasurements(in);
+    const auto start = std::chrono::steady_clock::now();
+    const auto solutions = Fit::Solver(options).solve(samples);
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "id\teta\tetaK\ttheta\trho\trms\titerations\n";
+    for (const auto& s : solutions)
+        std::cout << s.id << '\t' << s.params[Fit::eEta] << '\t' << s.params[Fit::eEtaK] << '\t' << s.params[Fit::eTheta] << '\t'
+                  << s.params[Fit::eRho] << '\t' << s.rms << '\t' << s.iterations << (s.converged ? "" : " (not converged)") << '\n';
+    std::cerr << "Fitted " << solutions.size() << " samples in " << seconds << " s\n";
+    return EXIT_SUCCESS;
+}
 
 int main(int argc, char **argv)
 {
+    const InputParser input(argc, argv);
+    if (input.cmdOptionExists("-h") || input.cmdOptionExists("--help"))
+    {
+        std::cout << "polarization [--profile]\n";
+        std::cout << "polarization --render OUTPUT_PREFIX [-x WIDTH] [-y HEIGHT] [-s SAMPLES_PER_PIXEL] [-t THREADS] [--profile]\n";
+        std::cout << "polarization --fit MEASUREMENTS [--eta E] [--etaK K] [--theta DEG] [--rho DEG] [--fix eta,etaK,theta,rho] [-t THREADS] [--profile]\n";
+        return EXIT_SUCCESS;
+    }
+
+    const auto profile = input.cmdOptionExists("--profile");
+    if (profile)
+        Profiler::enable();
+
     std::cout.setf(std::ios::fixed);
     std::cout.precision(3);
+    if (!input.getCmdOption("--render").empty())
+    {
+        try
+        {
+            const auto status = render(input);
+            if (profile)
+                Profiler::printJson(std::cerr);
+            return status;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!input.getCmdOption("--fit").empty())
+    {
+        std::cout.precision(5);
+        try
+        {
+            const auto status = fit(input);
+            if (profile)
+                Profiler::printJson(std::cerr);
+            return status;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
     const auto etaInGlass = 1.0f / 1.5105f;
 
     std::vector<Scene::Scene> testScenes;
@@ -37,5 +198,8 @@ int main(int argc, char **argv)
     for (const auto& r : results)
         r.print();
 
+    if (profile)
+        Profiler::printJson(std::cerr);
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include <glm/vec3.hpp>
+
+#include "Spectrum.h"
+
+namespace Cache
+{
+    using Hash = std::uint64_t;
+
+    // FNV-1a, stable across runs so the cache can be persisted
+    inline Hash hashBytes(const void* data, std::size_t size, Hash h = 14695981039346656037ull)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; i++)
+        {
+            h ^= bytes[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    inline Hash combine(Hash seed, Hash value)
+    {
+        return hashBytes(&value, sizeof(value), seed);
+    }
+
+    inline Hash hash(const Spectrum::VisibleFull& spectrum)
+    {
+        return hashBytes(spectrum.data(), sizeof(float) * Spectrum::VisibleFull::LAMBDA_RANGE);
+    }
+
+    enum class Method : std::uint32_t
+    {
+        eFull,
+        eUniform,
+        eHero,
+        eMidpoint,
+        eSimpson,
+        eGaussLegendre,
+        eAdaptive
+    };
+
+    struct SamplerConfig
+    {
+        Method method = Method::eFull;
+        int sampleCount = 0;
+        // hero lane count, anything else that changes the estimate belongs here too
+        int lanes = 0;
+        // emission lines split off the luminary and added exactly
+        bool lines = false;
+
+        [[nodiscard]] Hash hash() const
+        {
+            auto h = combine(hashBytes(&method, sizeof(method)), static_cast<Hash>(sampleCount));
+            h = combine(h, static_cast<Hash>(lanes));
+            // keys without lines are unchanged
+            return lines ? combine(h, 1) : h;
+        }
+    };
+
+    struct Key
+    {
+        Hash luminary = 0;
+        Hash material = 0;
+        Hash config = 0;
+
+        bool operator==(const Key& rhs) const
+        {
+            return luminary == rhs.luminary && material == rhs.material && config == rhs.config;
+        }
+
+        [[nodiscard]] Hash hash() const
+        {
+            return combine(combine(luminary, material), config);
+        }
+
+        // random samplers restart from this seed, a recomputed entry equals the cached one
+        [[nodiscard]] std::uint32_t seed() const
+        {
+            const auto h = hash();
+            return static_cast<std::uint32_t>(h ^ (h >> 32));
+        }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& k) const
+        {
+            return static_cast<std::size_t>(k.hash());
+        }
+    };
+
+    // memoized colors keyed by the content of both spectra and the sampler configuration,
+    // editing one spectrum misses only on its own row or column
+    class ResultCache
+    {
+    public:
+        template<typename F>
+        glm::vec3 getOrCompute(const Key& key, F&& compute)
+        {
+            if (const auto it = entries.find(key); it != entries.end())
+            {
+                hitCount++;
+                return it->second;
+            }
+            missCount++;
+            return entries[key] = compute();
+        }
+
+        [[nodiscard]] long long hits() const { return hitCount; }
+        [[nodiscard]] long long misses() const { return missCount; }
+
+        enum class LoadStatus { eLoaded, eMissing, eForeign, eTruncated };
+
+        // anything but eLoaded leaves the cache empty
+        LoadStatus load(const std::string& path)
+        {
+            entries.clear();
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+                return LoadStatus::eMissing;
+            std::uint64_t magic = 0, count = 0;
+            if (!in.read(reinterpret_cast<char*>(&magic), sizeof(magic)))
+                return in.gcount() == 0 ? LoadStatus::eMissing : LoadStatus::eForeign;
+            if (magic != MAGIC)
+                return LoadStatus::eForeign;
+            if (!in.read(reinterpret_cast<char*>(&count), sizeof(count)))
+                return LoadStatus::eTruncated;
+            for (std::uint64_t i = 0; i < count; i++)
+            {
+                Entry e;
+                if (!in.read(reinterpret_cast<char*>(&e), sizeof(e)))
+                {
+                    entries.clear();
+                    return LoadStatus::eTruncated;
+                }
+                entries[e.key] = { e.color[0], e.color[1], e.color[2] };
+            }
+            return LoadStatus::eLoaded;
+        }
+
+        // never overwrites a non-empty file that is not a cache
+        bool save(const std::string& path) const
+        {
+            if (std::ifstream in(path, std::ios::binary); in)
+            {
+                std::uint64_t magic = 0;
+                if (in.read(reinterpret_cast<char*>(&magic), sizeof(magic)) ? magic != MAGIC : in.gcount() != 0)
+                    return false;
+            }
+
+            std::ofstream out(path, std::ios::binary);
+            const std::uint64_t count = entries.size();
+            out.write(reinterpret_cast<const char*>(&MAGIC), sizeof(MAGIC));
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const auto& [key, color] : entries)
+            {
+                Entry e{};
+                e.key = key;
+                e.color[0] = color.x;
+                e.color[1] = color.y;
+                e.color[2] = color.z;
+                out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+            }
+            return static_cast<bool>(out.flush());
+        }
+
+    private:
+        static constexpr std::uint64_t MAGIC = 0x3230454843414352ull; // "RCACHE02"
+
+        struct Entry
+        {
+            Key key;
+            float color[3];
+        };
+
+        std::unordered_map<Key, glm::vec3, KeyHash> entries;
+        long long hitCount = 0;
+        long long missCount = 0;
+    };
+}
@@ -16,7 +16,19 @@ namespace ColorSpace
         static const Spectrum::VisibleFull Z_CURVE;
     public:
         glm::vec3 color;
-        explicit XYZ(const Spectrum::VisibleFull& spectrum) : color((X_CURVE * spectrum).sum(), (Y_CURVE * spectrum).sum(), (Z_CURVE * spectrum).sum()) {}
+
+        [[nodiscard]] static glm::vec3 matchingFunction(int lambda)
+        {
+            return { X_CURVE[lambda], Y_CURVE[lambda], Z_CURVE[lambda] };
+        }
+
+        explicit XYZ(const glm::vec3& color) : color(color) {}
+
+        explicit XYZ(const Spectrum::VisibleFull& spectrum)
+        {
+            PROFILE_SCOPE("colorspace.xyz");
+            color = { (X_CURVE * spectrum).sum(), (Y_CURVE * spectrum).sum(), (Z_CURVE * spectrum).sum() };
+        }
     };
 
     class RGB
@@ -29,6 +41,17 @@ namespace ColorSpace
         explicit RGB(const XYZ& color) : color(toRGB(color)) {}
         explicit RGB(const Spectrum::VisibleFull& spectrum) : RGB(XYZ(spectrum)) {}
 
+        [[nodiscard]] static const glm::mat3& xyzToRgbMatrix()
+        {
+            return XYZ_TO_RGB_MATRIX;
+        }
+
+        // XYZ matching functions projected to RGB
+        [[nodiscard]] static glm::vec3 matchingFunction(int lambda)
+        {
+            return XYZ_TO_RGB_MATRIX * XYZ::matchingFunction(lambda);
+        }
+
         RGB& operator/=(const RGB& rhs)
         {
             color /= rhs.color;
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/matrix.hpp>
+
+#include "Spectrum.h"
+#include "ColorSpace.h"
+
+namespace ColorSpace
+{
+    enum class TargetId
+    {
+        eSRGB,
+        eRec2020,
+        eACEScg,
+        eDisplayP3,
+        eXYZ,
+        eCount
+    };
+
+    // linear output color space, XYZ values of the spectra are taken as D65 relative
+    struct Target
+    {
+        TargetId id;
+        const char* name;
+        glm::mat3 xyzToTarget;
+        // applied in front of xyzToTarget when chromatic adaptation is requested
+        glm::mat3 adaptation;
+
+        [[nodiscard]] glm::mat3 conversion(bool chromaticAdaptation) const
+        {
+            return chromaticAdaptation ? xyzToTarget * adaptation : xyzToTarget;
+        }
+    };
+
+    namespace Colorimetry
+    {
+        inline glm::mat3 rowMajor(float a, float b, float c, float d, float e, float f, float g, float h, float i)
+        {
+            return glm::transpose(glm::mat3(a, b, c, d, e, f, g, h, i));
+        }
+
+        inline glm::vec3 whiteXYZ(const glm::vec2& xy)
+        {
+            return { xy.x / xy.y, 1.0f, (1.0f - xy.x - xy.y) / xy.y };
+        }
+
+        inline const glm::vec2 D65{ 0.3127f, 0.3290f };
+        inline const glm::vec2 D60{ 0.32168f, 0.33767f };
+
+        inline glm::mat3 xyzToRgb(const glm::vec2& r, const glm::vec2& g, const glm::vec2& b, const glm::vec2& white)
+        {
+            const glm::mat3 primaries(whiteXYZ(r), whiteXYZ(g), whiteXYZ(b));
+            const auto scale = glm::inverse(primaries) * whiteXYZ(white);
+            const glm::mat3 rgbToXyz(primaries[0] * scale.x, primaries[1] * scale.y, primaries[2] * scale.z);
+            return glm::inverse(rgbToXyz);
+        }
+
+        // von Kries transform in the Bradford cone space
+        inline glm::mat3 bradford(const glm::vec2& from, const glm::vec2& to)
+        {
+            const auto cone = rowMajor(
+                0.8951f, 0.2664f, -0.1614f,
+                -0.7502f, 1.7135f, 0.0367f,
+                0.0389f, -0.0685f, 1.0296f);
+            const auto src = cone * whiteXYZ(from);
+            const auto dst = cone * whiteXYZ(to);
+            glm::mat3 gain(1.0f);
+            gain[0][0] = dst.x / src.x;
+            gain[1][1] = dst.y / src.y;
+            gain[2][2] = dst.z / src.z;
+            return glm::inverse(cone) * gain * cone;
+        }
+    }
+
+    inline const std::array<Target, static_cast<std::size_t>(TargetId::eCount)>& targets()
+    {
+        using namespace Colorimetry;
+        static const std::array<Target, static_cast<std::size_t>(TargetId::eCount)> registry = {{
+            // same matrix as RGB so both paths agree
+            { TargetId::eSRGB, "srgb", RGB::xyzToRgbMatrix(), glm::mat3(1.0f) },
+            { TargetId::eRec2020, "rec2020", xyzToRgb({ 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f }, D65), glm::mat3(1.0f) },
+            { TargetId::eACEScg, "acescg", xyzToRgb({ 0.713f, 0.293f }, { 0.165f, 0.830f }, { 0.128f, 0.044f }, D60), bradford(D65, D60) },
+            { TargetId::eDisplayP3, "p3", xyzToRgb({ 0.680f, 0.320f }, { 0.265f, 0.690f }, { 0.150f, 0.060f }, D65), glm::mat3(1.0f) },
+            { TargetId::eXYZ, "xyz", glm::mat3(1.0f), glm::mat3(1.0f) },
+        }};
+        return registry;
+    }
+
+    inline std::optional<TargetId> findTarget(const std::string& name)
+    {
+        for (const auto& t : targets())
+            if (name == t.name)
+                return t.id;
+        return std::nullopt;
+    }
+
+    inline const Target& target(TargetId id)
+    {
+        return targets()[static_cast<std::size_t>(id)];
+    }
+
+    // conversion folded into the matching functions: every output channel is a single dot product with the spectrum
+    // several targets are interleaved per wavelength so one sweep over the spectrum yields all of them
+    class SpectralBasis
+    {
+    public:
+        SpectralBasis(const std::vector<TargetId>& ids, bool chromaticAdaptation) : channelCount(3 * ids.size()), weights(channelCount * Spectrum::VisibleFull::LAMBDA_RANGE)
+        {
+            for (std::size_t t = 0; t < ids.size(); t++)
+            {
+                const auto m = target(ids[t]).conversion(chromaticAdaptation);
+                for (auto i = 0; i < Spectrum::VisibleFull::LAMBDA_RANGE; i++)
+                {
+                    const auto c = m * XYZ::matchingFunction(Spectrum::VisibleFull::LAMBDA_LOW + i);
+                    for (auto k = 0; k < 3; k++)
+                        weights[i * channelCount + 3 * t + k] = c[k];
+                }
+            }
+        }
+
+        // out receives 3 channels per target in construction order
+        void project(const Spectrum::VisibleFull& spectrum, float* out) const
+        {
+            PROFILE_SCOPE("colorspace.basis");
+            std::fill_n(out, channelCount, 0.0f);
+            const auto* s = spectrum.data();
+            for (auto i = 0; i < Spectrum::VisibleFull::LAMBDA_RANGE; i++)
+            {
+                const auto* w = &weights[i * channelCount];
+                for (std::size_t c = 0; c < channelCount; c++)
+                    out[c] += w[c] * s[i];
+            }
+        }
+
+        [[nodiscard]] std::size_t channels() const
+        {
+            return channelCount;
+        }
+
+    private:
+        std::size_t channelCount;
+        std::vector<float> weights;
+    };
+}
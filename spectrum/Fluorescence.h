@@ -0,0 +1,454 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <variant>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "Spectrum.h"
+#include "Sampler.h"
+#include "ColorSpace.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+// fluorescent materials described by a Donaldson re-radiation matrix D on the VisibleFull grid:
+// D[emission][excitation], the diagonal is the plain reflectance and the reflected radiance is D * luminary
+// the kernels work on several vectors at once, vectors are stored back to back with N floats each
+namespace Fluorescence
+{
+    constexpr int N = Spectrum::VisibleFull::LAMBDA_RANGE;
+
+    namespace Kernel
+    {
+        constexpr int LANES = Sampler::SIMD_LANES;
+
+        // partial sums over two vector registers, so the loop vectorizes without reassociation flags and
+        // consecutive adds do not wait on each other
+        inline float dot(const float* a, const float* b, int n)
+        {
+            constexpr int WIDTH = 2 * LANES;
+            std::array<float, WIDTH> sums{};
+            auto i = 0;
+            for (; i + WIDTH <= n; i += WIDTH)
+                for (auto k = 0; k < WIDTH; k++)
+                    sums[k] += a[i + k] * b[i + k];
+            for (; i < n; i++)
+                sums[0] += a[i] * b[i];
+            auto sum = 0.0f;
+            for (const auto s : sums)
+                sum += s;
+            return sum;
+        }
+
+        inline void axpy(float alpha, const float* x, float* y, int n)
+        {
+            for (auto i = 0; i < n; i++)
+                y[i] += alpha * x[i];
+        }
+
+        // y += sum_r alpha[r] * a[r * stride], y is loaded and stored once for ROWS rows
+        template<int ROWS>
+        void axpyRows(const float* alpha, const float* a, std::size_t stride, float* y, int n)
+        {
+            for (auto i = 0; i < n; i++)
+            {
+                auto acc = y[i];
+                for (auto r = 0; r < ROWS; r++)
+                    acc += alpha[r] * a[r * stride + i];
+                y[i] = acc;
+            }
+        }
+
+        // runs f(begin, end) over [0, count) in blocks, on the pool when one is given
+        template<typename F>
+        void forBlocks(int count, int block, ThreadPool* pool, F&& f)
+        {
+            const auto blocks = (count + block - 1) / block;
+            const auto run = [&](int b, unsigned) { f(b * block, std::min(count, (b + 1) * block)); };
+            if (pool)
+                pool->parallelFor(blocks, run);
+            else
+                for (auto b = 0; b < blocks; b++)
+                    run(b, 0);
+        }
+    }
+
+    // row-major with rows padded to the SIMD width
+    class Dense
+    {
+    public:
+        static constexpr int STRIDE = (N + Kernel::LANES - 1) / Kernel::LANES * Kernel::LANES;
+        // a block of rows times a block of columns stays in L1 while all vectors stream past it
+        static constexpr int BLOCK_ROWS = 32;
+        static constexpr int BLOCK_COLS = 128;
+        // rows folded into one pass over the output in the transposed product
+        static constexpr int ROW_TILE = 4;
+
+        Dense() : values(static_cast<std::size_t>(N) * STRIDE, 0.0f) {}
+
+        float& operator()(int emission, int excitation)
+        {
+            return values[static_cast<std::size_t>(emission) * STRIDE + excitation];
+        }
+
+        [[nodiscard]] float operator()(int emission, int excitation) const
+        {
+            return values[static_cast<std::size_t>(emission) * STRIDE + excitation];
+        }
+
+        [[nodiscard]] const float* row(int emission) const
+        {
+            return &values[static_cast<std::size_t>(emission) * STRIDE];
+        }
+
+        // y = D * x
+        void multiply(const float* x, float* y, int vectors, ThreadPool* pool = nullptr) const
+        {
+            PROFILE_SCOPE("fluorescence.dense");
+            Kernel::forBlocks(N, BLOCK_ROWS, pool, [&](int r0, int r1)
+            {
+                for (auto v = 0; v < vectors; v++)
+                    std::fill(y + v * N + r0, y + v * N + r1, 0.0f);
+                for (auto c0 = 0; c0 < N; c0 += BLOCK_COLS)
+                {
+                    const auto width = std::min(BLOCK_COLS, N - c0);
+                    for (auto v = 0; v < vectors; v++)
+                        for (auto r = r0; r < r1; r++)
+                            y[v * N + r] += Kernel::dot(row(r) + c0, x + v * N + c0, width);
+                }
+            });
+        }
+
+        // y = D^T * x
+        void multiplyTransposed(const float* x, float* y, int vectors, ThreadPool* pool = nullptr) const
+        {
+            PROFILE_SCOPE("fluorescence.dense");
+            Kernel::forBlocks(N, BLOCK_COLS, pool, [&](int c0, int c1)
+            {
+                for (auto v = 0; v < vectors; v++)
+                    std::fill(y + v * N + c0, y + v * N + c1, 0.0f);
+                for (auto r0 = 0; r0 < N; r0 += BLOCK_ROWS)
+                {
+                    const auto r1 = std::min(N, r0 + BLOCK_ROWS);
+                    for (auto v = 0; v < vectors; v++)
+                    {
+                        auto r = r0;
+                        for (; r + ROW_TILE <= r1; r += ROW_TILE)
+                            Kernel::axpyRows<ROW_TILE>(x + v * N + r, row(r) + c0, STRIDE, y + v * N + c0, c1 - c0);
+                        for (; r < r1; r++)
+                            Kernel::axpy(x[v * N + r], row(r) + c0, y + v * N + c0, c1 - c0);
+                    }
+                }
+            });
+        }
+
+        [[nodiscard]] std::size_t bytes() const
+        {
+            return values.size() * sizeof(float);
+        }
+
+    private:
+        std::vector<float> values;
+    };
+
+    // compressed sparse rows, entries below threshold * max |D| are dropped
+    class Sparse
+    {
+    public:
+        explicit Sparse(const Dense& d, float threshold = 1e-4f)
+        {
+            auto largest = 0.0f;
+            for (auto r = 0; r < N; r++)
+                for (auto c = 0; c < N; c++)
+                    largest = std::max(largest, std::abs(d(r, c)));
+            rowStart.push_back(0);
+            for (auto r = 0; r < N; r++)
+            {
+                for (auto c = 0; c < N; c++)
+                    if (std::abs(d(r, c)) > threshold * largest)
+                    {
+                        columns.push_back(c);
+                        values.push_back(d(r, c));
+                    }
+                rowStart.push_back(static_cast<int>(values.size()));
+            }
+        }
+
+        void multiply(const float* x, float* y, int vectors, ThreadPool* pool = nullptr) const
+        {
+            PROFILE_SCOPE("fluorescence.sparse");
+            Kernel::forBlocks(N, Dense::BLOCK_ROWS, pool, [&](int r0, int r1)
+            {
+                for (auto v = 0; v < vectors; v++)
+                    for (auto r = r0; r < r1; r++)
+                    {
+                        auto sum = 0.0f;
+                        for (auto j = rowStart[r]; j < rowStart[r + 1]; j++)
+                            sum += values[j] * x[v * N + columns[j]];
+                        y[v * N + r] = sum;
+                    }
+            });
+        }
+
+        // scatters along rows, so the vectors are what gets split over the pool
+        void multiplyTransposed(const float* x, float* y, int vectors, ThreadPool* pool = nullptr) const
+        {
+            PROFILE_SCOPE("fluorescence.sparse");
+            Kernel::forBlocks(vectors, 1, pool, [&](int v0, int v1)
+            {
+                for (auto v = v0; v < v1; v++)
+                {
+                    std::fill(y + v * N, y + (v + 1) * N, 0.0f);
+                    for (auto r = 0; r < N; r++)
+                        for (auto j = rowStart[r]; j < rowStart[r + 1]; j++)
+                            y[v * N + columns[j]] += values[j] * x[v * N + r];
+                }
+            });
+        }
+
+        [[nodiscard]] std::size_t nonZeros() const
+        {
+            return values.size();
+        }
+
+        [[nodiscard]] std::size_t bytes() const
+        {
+            return values.size() * (sizeof(float) + sizeof(int)) + rowStart.size() * sizeof(int);
+        }
+
+    private:
+        std::vector<int> rowStart;
+        std::vector<int> columns;
+        std::vector<float> values;
+    };
+
+    // diagonal reflectance plus a rank-K approximation of the re-radiation, D ~ diag(r) + sum_k u_k v_k^T
+    class LowRank
+    {
+    public:
+        // the off-diagonal part is projected onto its dominant excitation subspace, found by a few rounds of
+        // subspace iteration: D - diag(D) ~ (O V) V^T with orthonormal rows V
+        LowRank(const Dense& d, int rank) : diagonal(N)
+        {
+            using Basis = std::vector<std::vector<double>>;
+            std::vector<double> off(static_cast<std::size_t>(N) * N);
+            for (auto r = 0; r < N; r++)
+            {
+                diagonal[r] = d(r, r);
+                for (auto c = 0; c < N; c++)
+                    off[static_cast<std::size_t>(r) * N + c] = r == c ? 0.0 : d(r, c);
+            }
+            const auto times = [&off](const Basis& in, bool transposed)
+            {
+                Basis out(in.size(), std::vector<double>(N, 0.0));
+                for (std::size_t k = 0; k < in.size(); k++)
+                    for (auto r = 0; r < N; r++)
+                        for (auto c = 0; c < N; c++)
+                        {
+                            const auto value = off[static_cast<std::size_t>(r) * N + c];
+                            if (transposed)
+                                out[k][c] += value * in[k][r];
+                            else
+                                out[k][r] += value * in[k][c];
+                        }
+                return out;
+            };
+
+            std::mt19937 rng(rank);
+            std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+            Basis v(rank, std::vector<double>(N));
+            for (auto& row : v)
+                for (auto& e : row)
+                    e = uniform(rng);
+            orthonormalize(v);
+            for (auto iter = 0; iter < SUBSPACE_ITERATIONS && !v.empty(); iter++)
+            {
+                auto u = times(v, false);
+                orthonormalize(u);
+                v = times(u, true);
+                orthonormalize(v);
+            }
+
+            const auto u = times(v, false);
+            for (std::size_t k = 0; k < v.size(); k++)
+                for (auto i = 0; i < N; i++)
+                {
+                    emission.push_back(static_cast<float>(u[k][i]));
+                    excitation.push_back(static_cast<float>(v[k][i]));
+                }
+        }
+
+        [[nodiscard]] int rank() const
+        {
+            return static_cast<int>(emission.size() / N);
+        }
+
+        void multiply(const float* x, float* y, int vectors, ThreadPool* pool = nullptr) const
+        {
+            apply(excitation, emission, x, y, vectors, pool);
+        }
+
+        void multiplyTransposed(const float* x, float* y, int vectors, ThreadPool* pool = nullptr) const
+        {
+            apply(emission, excitation, x, y, vectors, pool);
+        }
+
+        [[nodiscard]] std::size_t bytes() const
+        {
+            return (diagonal.size() + emission.size() + excitation.size()) * sizeof(float);
+        }
+
+    private:
+        std::vector<float> diagonal;
+        // rank() vectors of N each
+        std::vector<float> emission;
+        std::vector<float> excitation;
+
+        static constexpr int SUBSPACE_ITERATIONS = 8;
+
+        // modified Gram-Schmidt, directions without energy left are dropped so the rank can shrink
+        static void orthonormalize(std::vector<std::vector<double>>& basis)
+        {
+            std::vector<std::vector<double>> result;
+            for (auto& b : basis)
+            {
+                for (const auto& q : result)
+                {
+                    auto projection = 0.0;
+                    for (auto i = 0; i < N; i++)
+                        projection += q[i] * b[i];
+                    for (auto i = 0; i < N; i++)
+                        b[i] -= projection * q[i];
+                }
+                auto norm = 0.0;
+                for (const auto e : b)
+                    norm += e * e;
+                norm = std::sqrt(norm);
+                if (norm <= 1e-12)
+                    continue;
+                for (auto& e : b)
+                    e /= norm;
+                result.push_back(std::move(b));
+            }
+            basis = std::move(result);
+        }
+
+        // y = diag(r) x + sum_k out_k (in_k . x)
+        void apply(const std::vector<float>& in, const std::vector<float>& out, const float* x, float* y, int vectors, ThreadPool* pool) const
+        {
+            PROFILE_SCOPE("fluorescence.lowrank");
+            Kernel::forBlocks(vectors, 1, pool, [&](int v0, int v1)
+            {
+                for (auto v = v0; v < v1; v++)
+                {
+                    const auto* xv = x + v * N;
+                    auto* yv = y + v * N;
+                    for (auto i = 0; i < N; i++)
+                        yv[i] = diagonal[i] * xv[i];
+                    for (auto k = 0; k < rank(); k++)
+                        Kernel::axpy(Kernel::dot(&in[k * N], xv, N), &out[k * N], yv, N);
+                }
+            });
+        }
+    };
+
+    using Storage = std::variant<Dense, Sparse, LowRank>;
+
+    class Material
+    {
+    public:
+        // the matching functions are pushed through D^T once, every luminary then costs three dot products
+        explicit Material(Storage storage) : storage(std::move(storage)), xyzWeights(3 * N)
+        {
+            std::vector<float> cmf(3 * N);
+            for (auto i = 0; i < N; i++)
+            {
+                const auto c = ColorSpace::XYZ::matchingFunction(Spectrum::VisibleFull::LAMBDA_LOW + i);
+                cmf[i] = c.x;
+                cmf[N + i] = c.y;
+                cmf[2 * N + i] = c.z;
+            }
+            std::visit([&](const auto& d) { d.multiplyTransposed(cmf.data(), xyzWeights.data(), 3); }, this->storage);
+        }
+
+        // reflected and re-emitted radiance
+        [[nodiscard]] Spectrum::VisibleFull radiance(const Spectrum::VisibleFull& luminary) const
+        {
+            std::array<float, N> out;
+            std::visit([&](const auto& d) { d.multiply(luminary.data(), out.data(), 1); }, storage);
+            return Spectrum::VisibleFull(out.data());
+        }
+
+        // all luminaries in one matrix-matrix product
+        [[nodiscard]] std::vector<Spectrum::VisibleFull> radiance(const std::vector<Spectrum::VisibleFull>& luminaries, ThreadPool* pool = nullptr) const
+        {
+            const auto count = static_cast<int>(luminaries.size());
+            std::vector<float> in(static_cast<std::size_t>(count) * N), out(in.size());
+            for (auto l = 0; l < count; l++)
+                std::copy_n(luminaries[l].data(), N, &in[static_cast<std::size_t>(l) * N]);
+            std::visit([&](const auto& d) { d.multiply(in.data(), out.data(), count, pool); }, storage);
+
+            std::vector<Spectrum::VisibleFull> result;
+            for (auto l = 0; l < count; l++)
+                result.emplace_back(&out[static_cast<std::size_t>(l) * N]);
+            return result;
+        }
+
+        [[nodiscard]] glm::vec3 xyz(const Spectrum::VisibleFull& luminary) const
+        {
+            return { Kernel::dot(&xyzWeights[0], luminary.data(), N),
+                     Kernel::dot(&xyzWeights[N], luminary.data(), N),
+                     Kernel::dot(&xyzWeights[2 * N], luminary.data(), N) };
+        }
+
+        [[nodiscard]] const Storage& matrix() const
+        {
+            return storage;
+        }
+
+    private:
+        Storage storage;
+        std::vector<float> xyzWeights;
+    };
+
+    // XYZ of every material under every luminary, result[m * luminaries + l], materials are split over the pool
+    inline std::vector<glm::vec3> evaluate(const std::vector<Material>& materials, const std::vector<Spectrum::VisibleFull>& luminaries, ThreadPool& pool)
+    {
+        PROFILE_SCOPE("fluorescence.batch");
+        std::vector<glm::vec3> result(materials.size() * luminaries.size());
+        const auto lumCount = static_cast<int>(luminaries.size());
+        Kernel::forBlocks(static_cast<int>(materials.size()), 16, &pool, [&](int m0, int m1)
+        {
+            for (auto m = m0; m < m1; m++)
+                for (auto l = 0; l < lumCount; l++)
+                    result[static_cast<std::size_t>(m) * lumCount + l] = materials[m].xyz(luminaries[l]);
+        });
+        PROFILE_COUNT("fluorescence.batch", result.size());
+        return result;
+    }
+
+    // synthetic Donaldson matrix: reflectance on the diagonal plus Gaussian excitation and emission bands,
+    // re-emission only towards longer wavelengths (Stokes shift)
+    inline Dense synthetic(const Spectrum::VisibleFull& reflectance, float excitationPeak, float emissionPeak, float width, float yield)
+    {
+        Dense d;
+        // cut at 6 sigma, the far tails would otherwise be denormals that slow every kernel down
+        const auto gauss = [width](float x, float mu)
+        {
+            const auto t = (x - mu) / width;
+            return std::abs(t) > 6.0f ? 0.0f : std::exp(-0.5f * t * t);
+        };
+        for (auto o = 0; o < N; o++)
+        {
+            const auto emission = gauss(static_cast<float>(Spectrum::VisibleFull::LAMBDA_LOW + o), emissionPeak);
+            d(o, o) = reflectance[Spectrum::VisibleFull::LAMBDA_LOW + o];
+            for (auto i = 0; i < o; i++)
+                d(o, i) = yield * emission * gauss(static_cast<float>(Spectrum::VisibleFull::LAMBDA_LOW + i), excitationPeak) / width;
+        }
+        return d;
+    }
+}
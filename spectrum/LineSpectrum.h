@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "Spectrum.h"
+
+namespace Spectrum
+{
+    // illuminant split into a smooth continuum and narrow emission lines, continuum + lines equals the
+    // interpolated illuminant exactly; lines are summed in full against the material while the continuum
+    // goes through a sampler or quadrature rule, so samples are no longer spent on the spikes
+    class LineContinuum
+    {
+    public:
+        struct Line
+        {
+            // first 1 nm sample of the window
+            int lambda = 0;
+            // line emission above the continuum, one value per nm
+            std::vector<float> values;
+        };
+
+        // openingRadius (nm) must exceed half the width of the widest line, a line must rise at least
+        // minContrast times the continuum above it
+        explicit LineContinuum(const Arbitrary& illuminant, int openingRadius = 10, float minContrast = 1.0f)
+        {
+            const auto full = illuminant.toVisibleFull();
+            const auto base = opening(illuminant, openingRadius).toVisibleFull();
+
+            std::array<float, VisibleFull::LAMBDA_RANGE> residual{};
+            for (auto i = 0; i < VisibleFull::LAMBDA_RANGE; i++)
+                residual[i] = std::max(0.0f, full[VisibleFull::LAMBDA_LOW + i] - base[VisibleFull::LAMBDA_LOW + i]);
+
+            // every table sample standing out from the opened curve seeds a window, which grows until the residual vanishes
+            std::vector<bool> inLine(VisibleFull::LAMBDA_RANGE, false);
+            for (const auto& [lambda, value] : illuminant.values)
+            {
+                if (lambda < VisibleFull::LAMBDA_LOW || lambda >= VisibleFull::LAMBDA_HIGH)
+                    continue;
+                const auto i = lambda - VisibleFull::LAMBDA_LOW;
+                if (residual[i] <= 0.0f || residual[i] < minContrast * base[lambda])
+                    continue;
+                auto first = i, last = i;
+                while (first > 0 && residual[first - 1] > 0.0f)
+                    first--;
+                while (last < VisibleFull::LAMBDA_RANGE - 1 && residual[last + 1] > 0.0f)
+                    last++;
+                std::fill(inLine.begin() + first, inLine.begin() + last + 1, true);
+            }
+
+            continuumSpectrum = full;
+            for (auto i = 0; i < VisibleFull::LAMBDA_RANGE;)
+            {
+                if (!inLine[i])
+                {
+                    i++;
+                    continue;
+                }
+                Line line;
+                line.lambda = VisibleFull::LAMBDA_LOW + i;
+                for (; i < VisibleFull::LAMBDA_RANGE && inLine[i]; i++)
+                {
+                    const auto lambda = VisibleFull::LAMBDA_LOW + i;
+                    line.values.push_back(residual[i]);
+                    continuumSpectrum[lambda] -= residual[i];
+                }
+                lineList.push_back(std::move(line));
+            }
+        }
+
+        [[nodiscard]] const VisibleFull& continuum() const
+        {
+            return continuumSpectrum;
+        }
+
+        [[nodiscard]] const std::vector<Line>& lines() const
+        {
+            return lineList;
+        }
+
+        // 1 nm samples covered by lines
+        [[nodiscard]] int lineSamples() const
+        {
+            auto n = 0;
+            for (const auto& line : lineList)
+                n += static_cast<int>(line.values.size());
+            return n;
+        }
+
+        // continuum estimated by continuumEval(continuum, material), lines added exactly
+        template<typename F>
+        [[nodiscard]] VisibleFull eval(const VisibleFull& material, F&& continuumEval) const
+        {
+            PROFILE_SCOPE("spectrum.lines");
+            auto result = continuumEval(continuumSpectrum, material);
+            for (const auto& line : lineList)
+                for (std::size_t j = 0; j < line.values.size(); j++)
+                {
+                    const auto lambda = line.lambda + static_cast<int>(j);
+                    result[lambda] += line.values[j] * material[lambda];
+                }
+            return result;
+        }
+
+    private:
+        VisibleFull continuumSpectrum;
+        std::vector<Line> lineList;
+
+        // grey-scale opening (erosion then dilation) over a window of +-radius nm, removes peaks narrower than the window
+        static Arbitrary opening(const Arbitrary& s, int radius)
+        {
+            const auto filter = [radius](const Arbitrary& in, bool erode)
+            {
+                Arbitrary out;
+                for (const auto& [lambda, value] : in.values)
+                {
+                    auto v = value;
+                    for (auto it = in.values.lower_bound(lambda - radius); it != in.values.end() && it->first <= lambda + radius; ++it)
+                        v = erode ? std::min(v, it->second) : std::max(v, it->second);
+                    out.values[lambda] = v;
+                }
+                return out;
+            };
+            return filter(filter(s, true), false);
+        }
+    };
+}
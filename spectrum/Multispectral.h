@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/mat3x3.hpp>
+
+#include "Spectrum.h"
+#include "ColorSpace.h"
+#include "ColorTargets.h"
+#include "ImageIO.h"
+#include "ThreadPool.h"
+
+namespace Multispectral
+{
+    enum class Interleave
+    {
+        eBSQ, // band sequential, one full image per band
+        eBIL, // band interleaved by line
+        eBIP  // band interleaved by pixel
+    };
+
+    // raw little-endian float32 cube
+    struct ImageDesc
+    {
+        int width = 0;
+        int height = 0;
+        Interleave interleave = Interleave::eBSQ;
+        std::size_t headerOffset = 0;
+        // band centers in nm, ascending
+        std::vector<float> wavelengths;
+
+        [[nodiscard]] int bands() const
+        {
+            return static_cast<int>(wavelengths.size());
+        }
+
+        [[nodiscard]] std::size_t byteSize() const
+        {
+            return headerOffset + sizeof(float) * static_cast<std::size_t>(width) * height * bands();
+        }
+
+        // element stride between consecutive bands of one pixel and between consecutive pixels of one row
+        [[nodiscard]] std::size_t bandStride() const
+        {
+            switch (interleave)
+            {
+                case Interleave::eBSQ: return static_cast<std::size_t>(width) * height;
+                case Interleave::eBIL: return static_cast<std::size_t>(width);
+                default: return 1;
+            }
+        }
+
+        [[nodiscard]] std::size_t pixelStride() const
+        {
+            return interleave == Interleave::eBIP ? static_cast<std::size_t>(bands()) : 1;
+        }
+
+        [[nodiscard]] std::size_t rowOffset(int y) const
+        {
+            switch (interleave)
+            {
+                case Interleave::eBSQ: return static_cast<std::size_t>(y) * width;
+                default: return static_cast<std::size_t>(y) * width * bands();
+            }
+        }
+
+        // BandMatrix needs at least one band and strictly ascending centers
+        void validate() const
+        {
+            if (width < 1 || height < 1)
+                throw std::runtime_error("image width and height must be at least 1");
+            if (wavelengths.empty())
+                throw std::runtime_error("images need at least one band");
+            if (std::adjacent_find(wavelengths.begin(), wavelengths.end(), std::greater_equal<>()) != wavelengths.end())
+                throw std::runtime_error("band wavelengths must be strictly ascending");
+        }
+
+        // evenly spaced bands from low to high inclusive
+        static std::vector<float> evenlySpaced(int bands, float low, float high)
+        {
+            std::vector<float> w(static_cast<std::size_t>(std::max(bands, 0)));
+            for (auto b = 0; b < bands; b++)
+                w[b] = bands > 1 ? low + (high - low) * static_cast<float>(b) / static_cast<float>(bands - 1) : low;
+            return w;
+        }
+    };
+
+    // subset of the ENVI header format: samples, lines, interleave, data type 4, byte order 0, header offset, wavelength
+    inline ImageDesc readEnviHeader(const std::string& path)
+    {
+        std::ifstream in(path);
+        if (!in)
+            throw std::runtime_error("cannot open " + path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        auto text = ss.str();
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+        const auto value = [&](const std::string& key) -> std::string
+        {
+            for (auto pos = text.find(key); pos != std::string::npos; pos = text.find(key, pos + 1))
+            {
+                // whole key at the start of a line
+                if (pos != 0 && text[pos - 1] != '\n')
+                    continue;
+                const auto eq = text.find('=', pos);
+                if (eq == std::string::npos || text.find_first_not_of(" \t", pos + key.size()) != eq)
+                    continue;
+                const auto begin = text.find_first_not_of(" \t", eq + 1);
+                if (begin != std::string::npos && text[begin] == '{')
+                    return text.substr(begin + 1, text.find('}', begin) - begin - 1);
+                return text.substr(begin, text.find('\n', begin) - begin);
+            }
+            return {};
+        };
+
+        ImageDesc desc;
+        desc.width = std::stoi(value("samples"));
+        desc.height = std::stoi(value("lines"));
+        const auto bands = std::stoi(value("bands"));
+        if (const auto v = value("data type"); !v.empty() && std::stoi(v) != 4)
+            throw std::runtime_error("only float32 (data type = 4) images are supported");
+        if (const auto v = value("byte order"); !v.empty() && std::stoi(v) != 0)
+            throw std::runtime_error("only little-endian (byte order = 0) images are supported");
+        if (const auto v = value("header offset"); !v.empty())
+            desc.headerOffset = static_cast<std::size_t>(std::stoll(v));
+        if (const auto v = value("interleave"); v.find("bil") != std::string::npos)
+            desc.interleave = Interleave::eBIL;
+        else if (v.find("bip") != std::string::npos)
+            desc.interleave = Interleave::eBIP;
+
+        std::stringstream list(value("wavelength"));
+        for (std::string token; std::getline(list, token, ',');)
+            desc.wavelengths.push_back(std::stof(token));
+        if (desc.wavelengths.empty())
+            throw std::runtime_error("no wavelength list in " + path);
+        if (static_cast<int>(desc.wavelengths.size()) != bands)
+            throw std::runtime_error("wavelength list does not match the band count in " + path);
+        // micrometer headers
+        if (desc.wavelengths.back() < 10.0f)
+            for (auto& w : desc.wavelengths)
+                w *= 1000.0f;
+        desc.validate();
+        return desc;
+    }
+
+    // reflectance bands to output channels: the bands are lerped onto the 1 nm grid like Arbitrary::toVisibleFull,
+    // multiplied by the illuminant and the matching functions and summed, all folded into one 3 x bands matrix
+    // a perfect white reflector maps to Y = 1
+    class BandMatrix
+    {
+    public:
+        BandMatrix(const std::vector<float>& wavelengths, const Spectrum::VisibleFull& illuminant, const glm::mat3& xyzToOutput) :
+            bandCount(static_cast<int>(wavelengths.size())), weights(3 * wavelengths.size(), 0.0f)
+        {
+            auto whiteY = 0.0f;
+            for (auto l = Spectrum::VisibleFull::LAMBDA_LOW; l < Spectrum::VisibleFull::LAMBDA_HIGH; l++)
+            {
+                const auto lit = illuminant[l] * ColorSpace::XYZ::matchingFunction(l);
+                whiteY += lit.y;
+                const auto c = xyzToOutput * lit;
+
+                // outside the captured range the edge band is held
+                const auto lambda = static_cast<float>(l);
+                const auto upper = std::upper_bound(wavelengths.begin(), wavelengths.end(), lambda);
+                if (upper == wavelengths.begin() || upper == wavelengths.end())
+                {
+                    add(upper == wavelengths.begin() ? 0 : bandCount - 1, c);
+                    continue;
+                }
+                const auto b = static_cast<int>(upper - wavelengths.begin());
+                const auto t = (lambda - wavelengths[b - 1]) / (wavelengths[b] - wavelengths[b - 1]);
+                add(b - 1, c * (1.0f - t));
+                add(b, c * t);
+            }
+            for (auto& w : weights)
+                w /= whiteY;
+        }
+
+        [[nodiscard]] int bands() const
+        {
+            return bandCount;
+        }
+
+        // count consecutive pixels of a row into interleaved 3 channel out
+        // bands are the outer loop so band sequential and line interleaved rows are read contiguously
+        void apply(const float* row, int count, std::size_t pixelStride, std::size_t bandStride, float* out) const
+        {
+            std::fill_n(out, 3 * count, 0.0f);
+            for (auto i = 0; i < bandCount; i++)
+            {
+                const auto* band = row + i * bandStride;
+                const auto r = weights[3 * i], g = weights[3 * i + 1], b = weights[3 * i + 2];
+                for (auto x = 0; x < count; x++)
+                {
+                    const auto v = band[x * pixelStride];
+                    out[3 * x] += r * v;
+                    out[3 * x + 1] += g * v;
+                    out[3 * x + 2] += b * v;
+                }
+            }
+        }
+
+    private:
+        int bandCount;
+        // interleaved per band
+        std::vector<float> weights;
+
+        void add(int band, const glm::vec3& c)
+        {
+            for (auto k = 0; k < 3; k++)
+                weights[3 * band + k] += c[k];
+        }
+    };
+
+    struct Settings
+    {
+        int tileSize = 64;
+        unsigned threads = 0;
+    };
+
+    struct Stats
+    {
+        double seconds = 0.0;
+        long long pixels = 0;
+        unsigned threads = 0;
+    };
+
+    // input and output are both memory-mapped and tiles go straight from one to the other,
+    // so the resident set stays at a few tiles per thread regardless of the image size
+    inline Stats convert(const std::string& inputPath, const ImageDesc& desc, const BandMatrix& matrix, const std::string& outputPath, const Settings& settings)
+    {
+        if (matrix.bands() != desc.bands())
+            throw std::runtime_error("band matrix does not match the image");
+        // the cube is read as floats straight from the mapping, whose start is page aligned
+        if (desc.headerOffset % sizeof(float) != 0)
+            throw std::runtime_error("header offset " + std::to_string(desc.headerOffset) + " is not a multiple of the float size");
+        // a band sequential tile reads one short row per band, spread over the whole file
+        const ImageIO::MappedInput input(inputPath, desc.interleave == Interleave::eBSQ ? ImageIO::Access::eRandom : ImageIO::Access::eSequential);
+        if (input.bytesSize() < desc.byteSize())
+            throw std::runtime_error(inputPath + " is smaller than its header describes");
+        const auto* cube = reinterpret_cast<const float*>(input.data() + desc.headerOffset);
+
+        ImageIO::PfmImage output(outputPath, desc.width, desc.height, 3);
+        const auto tilesX = (desc.width + settings.tileSize - 1) / settings.tileSize;
+        const auto tilesY = (desc.height + settings.tileSize - 1) / settings.tileSize;
+        const auto bandStride = desc.bandStride();
+        const auto pixelStride = desc.pixelStride();
+
+        ThreadPool pool(settings.threads);
+        const auto start = std::chrono::steady_clock::now();
+        pool.parallelFor(tilesX * tilesY, [&](int tile, unsigned)
+        {
+            PROFILE_SCOPE("multispectral.tile");
+            const auto x0 = (tile % tilesX) * settings.tileSize;
+            const auto y0 = (tile / tilesX) * settings.tileSize;
+            const auto x1 = std::min(x0 + settings.tileSize, desc.width);
+            const auto y1 = std::min(y0 + settings.tileSize, desc.height);
+            for (auto y = y0; y < y1; y++)
+                matrix.apply(cube + desc.rowOffset(y) + x0 * pixelStride, x1 - x0, pixelStride, bandStride, &output.at(x0, y));
+            PROFILE_COUNT("multispectral.tile", (x1 - x0) * (y1 - y0));
+        });
+
+        Stats stats;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.pixels = static_cast<long long>(desc.width) * desc.height;
+        stats.threads = pool.size();
+        return stats;
+    }
+}
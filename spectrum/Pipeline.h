@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "Spectrum.h"
+#include "ColorSpace.h"
+
+namespace Pipeline
+{
+    using Luminaries = std::vector<std::pair<std::string, Spectrum::VisibleFull>>;
+
+    struct Settings
+    {
+        int resampleThreads = 1;
+        int evaluateThreads = 1;
+        // items in flight between two stages, bounds the peak memory
+        std::size_t queueCapacity = 256;
+    };
+
+    struct Stats
+    {
+        long long spectra = 0;
+        // malformed records, reported on stderr and skipped
+        long long rejected = 0;
+        double seconds = 0.0;
+    };
+
+    // streams a spectral library through read -> parse/resample -> evaluate -> write,
+    // every stage runs on its own threads and only a bounded number of records is alive at once
+    //
+    // input: one material per line, "NAME {lambda, value}, {lambda, value}, ..."
+    // output: one line per material, "INDEX NAME" followed by the RGB under every luminary,
+    // lines leave in completion order, INDEX is the input line number
+    class LibraryEvaluator
+    {
+    public:
+        LibraryEvaluator(Luminaries luminaries, const Settings& settings) : luminaries(std::move(luminaries)), settings(settings) {}
+
+        Stats run(std::istream& in, std::ostream& out) const
+        {
+            BoundedQueue<Text> texts(settings.queueCapacity, 1);
+            BoundedQueue<Resampled> spectra(settings.queueCapacity, settings.resampleThreads);
+            BoundedQueue<Evaluated> colors(settings.queueCapacity, settings.evaluateThreads);
+
+            const auto start = std::chrono::steady_clock::now();
+            std::atomic<long long> rejected = 0;
+            std::vector<std::thread> threads;
+            threads.emplace_back([&] { read(in, texts); });
+            for (auto i = 0; i < settings.resampleThreads; i++)
+                threads.emplace_back([&] { resample(texts, spectra, rejected); });
+            for (auto i = 0; i < settings.evaluateThreads; i++)
+                threads.emplace_back([&] { evaluate(spectra, colors); });
+
+            Stats stats;
+            stats.spectra = write(colors, out);
+            for (auto& t : threads)
+                t.join();
+            stats.rejected = rejected;
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return stats;
+        }
+
+    private:
+        struct Text
+        {
+            long long index = 0;
+            std::string name;
+            std::string data;
+        };
+
+        struct Resampled
+        {
+            long long index = 0;
+            std::string name;
+            Spectrum::VisibleFull spectrum;
+        };
+
+        struct Evaluated
+        {
+            long long index = 0;
+            std::string name;
+            std::vector<ColorSpace::RGB> rgb;
+        };
+
+        Luminaries luminaries;
+        Settings settings;
+
+        static void read(std::istream& in, BoundedQueue<Text>& out)
+        {
+            std::string line;
+            for (long long index = 0; std::getline(in, line); index++)
+            {
+                const auto split = line.find_first_of(" \t");
+                if (line.empty() || split == std::string::npos)
+                    continue;
+                PROFILE_COUNT("pipeline.read", 1);
+                out.push({ index, line.substr(0, split), line.substr(split + 1) });
+            }
+            out.close();
+        }
+
+        // a bad record is reported with its line index and dropped, the rest of the library keeps flowing
+        static void resample(BoundedQueue<Text>& in, BoundedQueue<Resampled>& out, std::atomic<long long>& rejected)
+        {
+            Spectrum::Parser parser;
+            Text t;
+            while (in.pop(t))
+            {
+                PROFILE_COUNT("pipeline.resample", 1);
+                std::string error;
+                try
+                {
+                    const auto spectrum = parser.parseMathematicaString(t.data.c_str());
+                    if (spectrum.coversVisible())
+                    {
+                        out.push({ t.index, std::move(t.name), spectrum.toVisibleFull() });
+                        continue;
+                    }
+                    error = "does not cover " + std::to_string(Spectrum::VisibleFull::LAMBDA_LOW) + "-" + std::to_string(Spectrum::VisibleFull::LAMBDA_HIGH - 1) + " nm";
+                }
+                catch (const std::exception& e)
+                {
+                    error = e.what();
+                }
+                rejected++;
+                // one write per message so lines from concurrent workers do not interleave
+                std::cerr << ("line " + std::to_string(t.index) + " (" + t.name + "): " + error + ", skipped\n");
+            }
+            out.close();
+        }
+
+        void evaluate(BoundedQueue<Resampled>& in, BoundedQueue<Evaluated>& out) const
+        {
+            Resampled r;
+            while (in.pop(r))
+            {
+                Evaluated e{ r.index, std::move(r.name), {} };
+                {
+                    PROFILE_SCOPE("pipeline.evaluate");
+                    e.rgb.reserve(luminaries.size());
+                    for (const auto& [lumName, lumSpectrum] : luminaries)
+                        e.rgb.emplace_back(lumSpectrum * r.spectrum);
+                }
+                out.push(std::move(e));
+            }
+            out.close();
+        }
+
+        long long write(BoundedQueue<Evaluated>& in, std::ostream& out) const
+        {
+            long long count = 0;
+            Evaluated e;
+            while (in.pop(e))
+            {
+                PROFILE_SCOPE("pipeline.write");
+                out << e.index << '\t' << e.name;
+                for (std::size_t i = 0; i < luminaries.size(); i++)
+                    out << "\t<" << luminaries[i].first << ">\t" << e.rgb[i].color.r << '\t' << e.rgb[i].color.g << '\t' << e.rgb[i].color.b;
+                out << '\n';
+                count++;
+            }
+            return count;
+        }
+    };
+}
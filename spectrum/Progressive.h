@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "Spectrum.h"
+#include "Sampler.h"
+#include "ColorSpace.h"
+
+namespace Progressive
+{
+    // Welford running mean and variance, one per color channel
+    struct RunningStats
+    {
+        long long n = 0;
+        glm::dvec3 mean{};
+        glm::dvec3 m2{};
+
+        void add(const glm::dvec3& x)
+        {
+            n++;
+            const auto delta = x - mean;
+            mean += delta / static_cast<double>(n);
+            m2 += delta * (x - mean);
+        }
+
+        [[nodiscard]] glm::dvec3 variance() const
+        {
+            return n > 1 ? m2 / static_cast<double>(n - 1) : glm::dvec3(0.0);
+        }
+
+        [[nodiscard]] glm::dvec3 standardError() const
+        {
+            const auto v = variance();
+            const auto dn = static_cast<double>(std::max(1LL, n));
+            return { std::sqrt(v.x / dn), std::sqrt(v.y / dn), std::sqrt(v.z / dn) };
+        }
+    };
+
+    // resumable RGB estimate of one luminary x material pair, more samples can be added at any time
+    template<typename S>
+    class Accumulator
+    {
+    public:
+        Accumulator(const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material, std::mt19937::result_type seed = 1) :
+            luminary(&luminary), material(&material), sampler(seed) {}
+
+        void addSamples(int count)
+        {
+            PROFILE_SCOPE("progressive.add");
+            PROFILE_COUNT("progressive.add", count);
+            for (auto i = 0; i < count; i++)
+            {
+                glm::vec3 rgb{};
+                sampler.draw([&](int lambda, float weight)
+                {
+                    rgb += ColorSpace::RGB::matchingFunction(lambda) * ((*luminary)[lambda] * (*material)[lambda] * weight);
+                });
+                stats.add(glm::dvec3(rgb.x, rgb.y, rgb.z));
+            }
+        }
+
+        [[nodiscard]] ColorSpace::RGB estimate() const
+        {
+            return ColorSpace::RGB(glm::vec3(stats.mean.x, stats.mean.y, stats.mean.z));
+        }
+
+        [[nodiscard]] double maxStandardError() const
+        {
+            const auto se = stats.standardError();
+            return std::max({ se.x, se.y, se.z });
+        }
+
+        [[nodiscard]] long long sampleCount() const
+        {
+            return stats.n;
+        }
+
+    private:
+        const Spectrum::VisibleFull* luminary;
+        const Spectrum::VisibleFull* material;
+        S sampler;
+        RunningStats stats;
+    };
+
+    struct AdaptiveParams
+    {
+        // absolute standard error per RGB channel
+        double targetError = 1.0;
+        double timeBudgetMs = 200.0;
+        int batchSize = 16;
+        // never stop on a variance estimate from fewer draws
+        int minSamples = 64;
+    };
+
+    // keeps adding batches to every pair that has not reached the target error until all converge or the budget runs out
+    template<typename S>
+    void refine(std::vector<Accumulator<S>>& pairs, const AdaptiveParams& params)
+    {
+        PROFILE_SCOPE("progressive.refine");
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(params.timeBudgetMs);
+        for (auto& p : pairs)
+            p.addSamples(params.minSamples);
+
+        for (;;)
+        {
+            auto active = false;
+            for (auto& p : pairs)
+                if (p.maxStandardError() > params.targetError)
+                {
+                    p.addSamples(params.batchSize);
+                    active = true;
+                }
+            if (!active || std::chrono::steady_clock::now() >= deadline)
+                return;
+        }
+    }
+}
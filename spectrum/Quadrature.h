@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/common.hpp>
+
+#include "Spectrum.h"
+#include "Sampler.h"
+#include "ColorSpace.h"
+
+// deterministic integration of luminary x material over the visible range
+// the 1 nm samples are read as a piecewise linear function held constant past both ends; its integral over
+// [LAMBDA_LOW - 0.5, LAMBDA_HIGH - 0.5] equals the plain sum of the samples, so every rule converges to the full evaluation
+namespace Quadrature
+{
+    enum class Method
+    {
+        eMidpoint,
+        eSimpson,
+        eGaussLegendre,
+        eAdaptive
+    };
+
+    constexpr double RANGE_LOW = Spectrum::VisibleFull::LAMBDA_LOW - 0.5;
+    constexpr double RANGE_HIGH = Spectrum::VisibleFull::LAMBDA_HIGH - 0.5;
+
+    // distributes a node weight onto the two neighbouring 1 nm samples, weights are indexed from LAMBDA_LOW
+    template<typename W>
+    void splat(double lambda, double weight, W& weights)
+    {
+        const auto x = std::clamp(lambda - Spectrum::VisibleFull::LAMBDA_LOW, 0.0, static_cast<double>(Spectrum::VisibleFull::LAMBDA_RANGE - 1));
+        const auto i = std::min(static_cast<int>(x), Spectrum::VisibleFull::LAMBDA_RANGE - 2);
+        const auto t = x - i;
+        weights[i] += weight * (1.0 - t);
+        weights[i + 1] += weight * t;
+    }
+
+    // Gauss-Legendre nodes and weights on [-1, 1], Newton iteration on the Legendre recurrence
+    inline std::vector<std::pair<double, double>> gaussLegendre(int n)
+    {
+        std::vector<std::pair<double, double>> nodes(n);
+        for (auto i = 0; i < (n + 1) / 2; i++)
+        {
+            auto x = std::cos(M_PI * (i + 0.75) / (n + 0.5));
+            double dp = 1.0;
+            for (auto iter = 0; iter < 100; iter++)
+            {
+                double p0 = 1.0, p1 = x;
+                for (auto k = 2; k <= n; k++)
+                {
+                    const auto p2 = ((2 * k - 1) * x * p1 - (k - 1) * p0) / k;
+                    p0 = p1;
+                    p1 = p2;
+                }
+                dp = n * (x * p1 - p0) / (x * x - 1.0);
+                const auto dx = p1 / dp;
+                x -= dx;
+                if (std::abs(dx) < 1e-15)
+                    break;
+            }
+            const auto w = 2.0 / ((1.0 - x * x) * dp * dp);
+            nodes[i] = { -x, w };
+            nodes[n - 1 - i] = { x, w };
+        }
+        return nodes;
+    }
+
+    // fixed rule reduced to a sparse weight per 1 nm sample, stored as separate index and weight arrays for a gather-dot
+    class Rule
+    {
+    public:
+        Rule(Method method, int sampleCount)
+        {
+            std::array<double, Spectrum::VisibleFull::LAMBDA_RANGE> dense{};
+            const auto width = RANGE_HIGH - RANGE_LOW;
+            switch (method)
+            {
+                case Method::eSimpson:
+                {
+                    // odd node count, composite over an even number of intervals
+                    const auto n = std::max(3, sampleCount % 2 == 0 ? sampleCount - 1 : sampleCount);
+                    const auto h = width / (n - 1);
+                    for (auto k = 0; k < n; k++)
+                        splat(RANGE_LOW + k * h, h / 3.0 * (k == 0 || k == n - 1 ? 1.0 : k % 2 == 1 ? 4.0 : 2.0), dense);
+                    break;
+                }
+                case Method::eGaussLegendre:
+                    for (const auto& [x, w] : gaussLegendre(std::max(1, sampleCount)))
+                        splat(RANGE_LOW + (x + 1.0) * 0.5 * width, w * 0.5 * width, dense);
+                    break;
+                default:
+                {
+                    const auto n = std::max(1, sampleCount);
+                    const auto h = width / n;
+                    for (auto k = 0; k < n; k++)
+                        splat(RANGE_LOW + (k + 0.5) * h, h, dense);
+                    break;
+                }
+            }
+
+            for (auto i = 0; i < Spectrum::VisibleFull::LAMBDA_RANGE; i++)
+                if (dense[i] != 0.0)
+                {
+                    indices.push_back(i);
+                    weights.push_back(static_cast<float>(dense[i]));
+                    const auto cmf = ColorSpace::XYZ::matchingFunction(Spectrum::VisibleFull::LAMBDA_LOW + i) * weights.back();
+                    weightsX.push_back(cmf.x);
+                    weightsY.push_back(cmf.y);
+                    weightsZ.push_back(cmf.z);
+                }
+        }
+
+        // 1 nm samples actually read, at most two per node
+        [[nodiscard]] int taps() const
+        {
+            return static_cast<int>(indices.size());
+        }
+
+        // weighted product spectrum, its color is the quadrature estimate
+        [[nodiscard]] Spectrum::VisibleFull eval(const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material) const
+        {
+            PROFILE_SCOPE("quadrature.eval");
+            PROFILE_COUNT("quadrature.eval", taps());
+            Spectrum::VisibleFull result;
+            const auto* l = luminary.data();
+            const auto* m = material.data();
+            for (std::size_t j = 0; j < indices.size(); j++)
+                result[Spectrum::VisibleFull::LAMBDA_LOW + indices[j]] = weights[j] * l[indices[j]] * m[indices[j]];
+            return result;
+        }
+
+        // integral of the product of two spectra
+        [[nodiscard]] float integrate(const Spectrum::VisibleFull& a, const Spectrum::VisibleFull& b) const
+        {
+            return gatherDot(weights.data(), a.data(), b.data());
+        }
+
+        // XYZ of the product with the matching functions folded into the weights, no intermediate spectrum
+        [[nodiscard]] glm::vec3 xyz(const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material) const
+        {
+            PROFILE_SCOPE("quadrature.xyz");
+            return { gatherDot(weightsX.data(), luminary.data(), material.data()),
+                     gatherDot(weightsY.data(), luminary.data(), material.data()),
+                     gatherDot(weightsZ.data(), luminary.data(), material.data()) };
+        }
+
+    private:
+        std::vector<int> indices;
+        std::vector<float> weights;
+        std::vector<float> weightsX, weightsY, weightsZ;
+
+        // one partial sum per SIMD lane so the loop vectorizes into gathers without reassociation flags
+        [[nodiscard]] float gatherDot(const float* w, const float* a, const float* b) const
+        {
+            constexpr auto LANES = Sampler::SIMD_LANES;
+            std::array<float, LANES> sums{};
+            const auto n = indices.size();
+            const auto* idx = indices.data();
+            std::size_t j = 0;
+            for (; j + LANES <= n; j += LANES)
+                for (auto k = 0; k < LANES; k++)
+                    sums[k] += w[j + k] * a[idx[j + k]] * b[idx[j + k]];
+            for (; j < n; j++)
+                sums[0] += w[j] * a[idx[j]] * b[idx[j]];
+            auto sum = 0.0f;
+            for (const auto s : sums)
+                sum += s;
+            return sum;
+        }
+    };
+
+    // more nodes than 1 nm samples add nothing, fixed rules are clamped to this count
+    constexpr int MAX_RULE_SAMPLES = Spectrum::VisibleFull::LAMBDA_RANGE;
+
+    // rules are built once per method and count on first use and never freed; after that a lookup is one atomic
+    // load, only the first call for a given rule allocates and takes the lock
+    inline const Rule& rule(Method method, int sampleCount)
+    {
+        constexpr int METHODS = static_cast<int>(Method::eAdaptive) + 1;
+        static std::array<std::atomic<const Rule*>, METHODS * MAX_RULE_SAMPLES> table{};
+        static std::mutex m;
+        static std::vector<std::unique_ptr<Rule>> owned;
+
+        const auto count = std::clamp(sampleCount, 1, MAX_RULE_SAMPLES);
+        auto& slot = table[static_cast<int>(method) * MAX_RULE_SAMPLES + count - 1];
+        if (const auto* r = slot.load(std::memory_order_acquire))
+            return *r;
+
+        std::lock_guard lock(m);
+        if (const auto* r = slot.load(std::memory_order_relaxed))
+            return *r;
+        owned.push_back(std::make_unique<Rule>(method, count));
+        slot.store(owned.back().get(), std::memory_order_release);
+        return *owned.back();
+    }
+
+    // adaptive Simpson on the XYZ integrand: half of the budget seeds evenly spaced panels, then the panel with the
+    // largest error relative to each channel's integral is halved until the total error drops below
+    // tolerance or the next split would exceed sampleCount evaluations
+    // one panel with its error estimate takes MIN_EVALUATIONS, smaller budgets are raised to that
+    class Adaptive
+    {
+    public:
+        static constexpr int MAX_PANELS = 256;
+        static constexpr int MIN_EVALUATIONS = 5;
+        // every panel split, larger budgets give the same result
+        static constexpr int MAX_EVALUATIONS = 4 * MAX_PANELS + 1;
+
+        [[nodiscard]] static Spectrum::VisibleFull eval(int sampleCount, const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material, double tolerance = 1e-4)
+        {
+            PROFILE_SCOPE("quadrature.adaptive");
+            sampleCount = std::max(sampleCount, MIN_EVALUATIONS);
+            const auto f = [&](double lambda)
+            {
+                const auto x = std::clamp(lambda - Spectrum::VisibleFull::LAMBDA_LOW, 0.0, static_cast<double>(Spectrum::VisibleFull::LAMBDA_RANGE - 1));
+                const auto i = std::min(static_cast<int>(x), Spectrum::VisibleFull::LAMBDA_RANGE - 2);
+                const auto t = x - i;
+                const auto l = Spectrum::VisibleFull::LAMBDA_LOW + i;
+                const auto a = glm::dvec3(ColorSpace::XYZ::matchingFunction(l)) * static_cast<double>(luminary[l] * material[l]);
+                const auto b = glm::dvec3(ColorSpace::XYZ::matchingFunction(l + 1)) * static_cast<double>(luminary[l + 1] * material[l + 1]);
+                return a * (1.0 - t) + b * t;
+            };
+
+            std::array<Panel, MAX_PANELS> panels;
+            const auto panelCount0 = std::clamp((sampleCount - 1) / 8, 1, MAX_PANELS / 2);
+            const auto width = (RANGE_HIGH - RANGE_LOW) / panelCount0;
+            auto fa = f(RANGE_LOW);
+            for (auto i = 0; i < panelCount0; i++)
+            {
+                const auto a = RANGE_LOW + i * width;
+                const auto fb = f(a + width);
+                panels[i] = makePanel(a, a + width, fa, f(a + 0.5 * width), fb, f);
+                fa = fb;
+            }
+            auto panelCount = panelCount0;
+            auto evaluations = 4 * panelCount + 1;
+
+            while (panelCount < MAX_PANELS && evaluations + 4 <= sampleCount)
+            {
+                glm::dvec3 error{}, total{};
+                for (auto i = 0; i < panelCount; i++)
+                {
+                    error += panels[i].error;
+                    total += panels[i].refined;
+                }
+                total = glm::max(glm::abs(total), glm::dvec3(1e-30));
+                if (error.x <= tolerance * total.x && error.y <= tolerance * total.y && error.z <= tolerance * total.z)
+                    break;
+
+                auto worst = 0;
+                auto worstScore = -1.0;
+                for (auto i = 0; i < panelCount; i++)
+                {
+                    const auto e = panels[i].error / total;
+                    const auto score = e.x + e.y + e.z;
+                    if (score > worstScore)
+                    {
+                        worst = i;
+                        worstScore = score;
+                    }
+                }
+
+                const auto p = panels[worst];
+                const auto mid = 0.5 * (p.a + p.b);
+                panels[worst] = makePanel(p.a, mid, p.fa, p.fl, p.fm, f);
+                panels[panelCount++] = makePanel(mid, p.b, p.fm, p.fr, p.fb, f);
+                evaluations += 4;
+            }
+            PROFILE_COUNT("quadrature.adaptive", evaluations);
+
+            // composite Simpson over the halves of every panel, splatted onto the 1 nm samples
+            std::array<double, Spectrum::VisibleFull::LAMBDA_RANGE> weights{};
+            for (auto i = 0; i < panelCount; i++)
+            {
+                const auto& p = panels[i];
+                const auto h = (p.b - p.a) / 12.0;
+                splat(p.a, h, weights);
+                splat(p.a + 0.25 * (p.b - p.a), 4.0 * h, weights);
+                splat(0.5 * (p.a + p.b), 2.0 * h, weights);
+                splat(p.a + 0.75 * (p.b - p.a), 4.0 * h, weights);
+                splat(p.b, h, weights);
+            }
+
+            Spectrum::VisibleFull result;
+            for (auto i = 0; i < Spectrum::VisibleFull::LAMBDA_RANGE; i++)
+                if (weights[i] != 0.0)
+                {
+                    const auto lambda = Spectrum::VisibleFull::LAMBDA_LOW + i;
+                    result[lambda] = static_cast<float>(weights[i]) * luminary[lambda] * material[lambda];
+                }
+            return result;
+        }
+
+    private:
+        struct Panel
+        {
+            double a = 0.0, b = 0.0;
+            // integrand at a, a + 1/4, the midpoint, a + 3/4 and b
+            glm::dvec3 fa{}, fl{}, fm{}, fr{}, fb{};
+            glm::dvec3 refined{};
+            glm::dvec3 error{};
+        };
+
+        template<typename F>
+        static Panel makePanel(double a, double b, const glm::dvec3& fa, const glm::dvec3& fm, const glm::dvec3& fb, const F& f)
+        {
+            Panel p{ a, b, fa, f(a + 0.25 * (b - a)), fm, f(a + 0.75 * (b - a)), fb };
+            const auto h = b - a;
+            const auto whole = h / 6.0 * (p.fa + 4.0 * p.fm + p.fb);
+            p.refined = h / 12.0 * (p.fa + 4.0 * p.fl + 2.0 * p.fm + 4.0 * p.fr + p.fb);
+            p.error = glm::abs(p.refined - whole) / 15.0;
+            return p;
+        }
+    };
+
+    // sample count a method actually uses for a requested budget, budgets outside its range give the same estimate
+    // as the nearest one inside
+    inline int sampleCount(Method method, int requested)
+    {
+        if (method == Method::eAdaptive)
+            return std::clamp(requested, Adaptive::MIN_EVALUATIONS, Adaptive::MAX_EVALUATIONS);
+        return std::clamp(requested, 1, MAX_RULE_SAMPLES);
+    }
+
+    // any method behind one call, used where the method is picked at runtime
+    inline Spectrum::VisibleFull eval(Method method, int sampleCount, const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material)
+    {
+        if (method == Method::eAdaptive)
+            return Adaptive::eval(sampleCount, luminary, material);
+        return rule(method, sampleCount).eval(luminary, material);
+    }
+
+    // XYZ of the estimate, fixed rules go through their CMF-folded weights and only touch the gathered samples
+    inline glm::vec3 xyz(Method method, int sampleCount, const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material)
+    {
+        if (method == Method::eAdaptive)
+            return ColorSpace::XYZ(Adaptive::eval(sampleCount, luminary, material)).color;
+        return rule(method, sampleCount).xyz(luminary, material);
+    }
+
+    inline const char* name(Method method)
+    {
+        switch (method)
+        {
+            case Method::eSimpson: return "Simpson";
+            case Method::eGaussLegendre: return "Gauss-Legendre";
+            case Method::eAdaptive: return "Adaptive Simpson";
+            default: return "Midpoint";
+        }
+    }
+}
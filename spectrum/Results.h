@@ -46,6 +46,7 @@ public:
 
     void print(const std::string& header) const
     {
+        PROFILE_SCOPE("result.print");
         std::cout << header << ":\n";
         for (const auto& lumName : lumSorted)
         {
@@ -61,6 +62,7 @@ public:
 
     void printT(const std::string& header) const
     {
+        PROFILE_SCOPE("result.print");
         std::cout << header << ":\n";
         for (const auto& matName : matSorted)
         {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <random>
 
@@ -24,13 +26,24 @@ namespace Sampler
     class Uniform
     {
     public:
+        explicit Uniform(std::mt19937::result_type seed = 1) : g(seed) {}
+
         int getSample()
         {
             return distrib(g.gen);
         }
 
+        // single estimator draw, f(lambda, 1 / pdf) is called for every wavelength of the draw
+        template<typename F>
+        void draw(F&& f)
+        {
+            f(getSample(), static_cast<float>(Spectrum::VisibleFull::LAMBDA_RANGE));
+        }
+
         [[nodiscard]] Spectrum::VisibleFull eval(int sampleCount, const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material)
         {
+            PROFILE_SCOPE("sampler.uniform");
+            PROFILE_COUNT("sampler.uniform", sampleCount);
             const auto pdf = 1.f / Spectrum::VisibleFull::LAMBDA_RANGE;
             Spectrum::VisibleFull result;
             for (auto i = 0; i < sampleCount; i++)
@@ -44,68 +57,79 @@ namespace Sampler
         }
 
     private:
-        RandomGenerator g{1};
+        RandomGenerator g;
         std::uniform_int_distribution<int> distrib{Spectrum::VisibleFull::LAMBDA_LOW, Spectrum::VisibleFull::LAMBDA_HIGH - 1};
     };
 
-    using ivec4 = std::array<int, 4>;
+    // float lanes of the widest vector unit enabled at compile time (SSE, AVX/AVX2, AVX-512)
+#if defined(__AVX512F__)
+    constexpr int SIMD_LANES = 16;
+#elif defined(__AVX__)
+    constexpr int SIMD_LANES = 8;
+#else
+    constexpr int SIMD_LANES = 4;
+#endif
+
+    // hero wavelength rotated continuously over the whole range, the remaining lanes follow
+    // at equal offsets with wrap-around, so every wavelength can be drawn
+    template<int Lanes = SIMD_LANES>
     class Hero
     {
+        static_assert(Lanes == 4 || Lanes == 8 || Lanes == 16, "lane count should match a SIMD width");
     public:
-        ivec4 getSample()
-        {
-            const auto s = distrib(g.gen);
-            return { s + 0*Spectrum::VisibleFull::LAMBDA_HERO_STEP,
-                     s + 1*Spectrum::VisibleFull::LAMBDA_HERO_STEP,
-                     s + 2*Spectrum::VisibleFull::LAMBDA_HERO_STEP,
-                     s + 3*Spectrum::VisibleFull::LAMBDA_HERO_STEP};
-        }
+        static constexpr int LANES = Lanes;
+        static constexpr float LANE_STEP = static_cast<float>(Spectrum::VisibleFull::LAMBDA_RANGE) / Lanes;
+        using Sample = std::array<int, Lanes>;
 
-        [[nodiscard]] Spectrum::VisibleFull eval(int sampleCount, const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material)
+        explicit Hero(std::mt19937::result_type seed = 1) : g(seed) {}
+
+        Sample getSample()
         {
-            const auto pdf = 1.f / Spectrum::VisibleFull::LAMBDA_HERO_STEP;
-            Spectrum::VisibleFull result;
-            for (auto i = 0; i < sampleCount; i++)
+            const auto hero = distrib(g.gen);
+            Sample lambdas;
+            for (auto j = 0; j < Lanes; j++)
             {
-                const auto lambdas = getSample();
-                for (auto lambda : lambdas)
-                    result[lambda] += luminary[lambda] * material[lambda] / pdf;
+                auto x = hero + static_cast<float>(j) * LANE_STEP;
+                if (x >= RANGE)
+                    x -= RANGE;
+                lambdas[j] = Spectrum::VisibleFull::LAMBDA_LOW + std::min(static_cast<int>(x), Spectrum::VisibleFull::LAMBDA_RANGE - 1);
             }
-            result *= 1 / static_cast<float>(sampleCount);
-            return result;
+            return lambdas;
         }
-    private:
-        RandomGenerator g{1};
-        // slightly distorted sampling due to defined visible wavelength range not being divisible by 4 - lambda 729 and 730 is never sampled
-        std::uniform_int_distribution<int> distrib{Spectrum::VisibleFull::LAMBDA_LOW, Spectrum::VisibleFull::LAMBDA_LOW + Spectrum::VisibleFull::LAMBDA_HERO_STEP};
-    };
 
-    class Equidistant
-    {
-    public:
-        static std::vector<int> getSample(int sampleCount)
+        template<typename F>
+        void draw(F&& f)
         {
-            const auto step = Spectrum::VisibleFull::LAMBDA_RANGE / sampleCount;
-            std::vector<int> samples;
-            samples.reserve(sampleCount);
-            for (auto i = 0; i < sampleCount; i++)
-                samples.emplace_back(Spectrum::VisibleFull::LAMBDA_LOW + i * step);
-
-            assert(samples.size() == sampleCount);
-            return samples;
+            for (auto lambda : getSample())
+                f(lambda, LANE_STEP);
         }
 
-        [[nodiscard]] static Spectrum::VisibleFull eval(int sampleCount, const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material)
+        [[nodiscard]] Spectrum::VisibleFull eval(int sampleCount, const Spectrum::VisibleFull& luminary, const Spectrum::VisibleFull& material)
         {
-            const auto pdf = 1.f / Spectrum::VisibleFull::LAMBDA_RANGE;
+            PROFILE_SCOPE("sampler.hero");
+            PROFILE_COUNT("sampler.hero", sampleCount * Lanes);
             Spectrum::VisibleFull result;
-
-            const auto lambdas = getSample(sampleCount);
-            for (auto lambda : lambdas)
-                result[lambda] += luminary[lambda] * material[lambda] / pdf;
-
+            std::array<float, Lanes> l, m, v;
+            for (auto i = 0; i < sampleCount; i++)
+            {
+                const auto lambdas = getSample();
+                for (auto j = 0; j < Lanes; j++)
+                {
+                    l[j] = luminary[lambdas[j]];
+                    m[j] = material[lambdas[j]];
+                }
+                // one vector multiply over all lanes
+                for (auto j = 0; j < Lanes; j++)
+                    v[j] = l[j] * m[j] * LANE_STEP;
+                for (auto j = 0; j < Lanes; j++)
+                    result[lambdas[j]] += v[j];
+            }
             result *= 1 / static_cast<float>(sampleCount);
             return result;
         }
+    private:
+        static constexpr auto RANGE = static_cast<float>(Spectrum::VisibleFull::LAMBDA_RANGE);
+        RandomGenerator g;
+        std::uniform_real_distribution<float> distrib{0.0f, RANGE};
     };
 }
\ No newline at end of file
@@ -1,11 +1,14 @@
 #pragma once
 
 #define DEBUG_LOG 0
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <array>
 #include <iostream>
 
+#include "Profiler.h"
+
 namespace Spectrum
 {
     class VisibleFull
@@ -14,7 +17,18 @@ namespace Spectrum
         static constexpr int LAMBDA_LOW = 380;
         static constexpr int LAMBDA_HIGH = 731;
         static constexpr int LAMBDA_RANGE = LAMBDA_HIGH - LAMBDA_LOW;
-        static constexpr int LAMBDA_HERO_STEP = LAMBDA_RANGE / 4;
+
+        VisibleFull() = default;
+        // LAMBDA_RANGE values sampled at 1 nm from LAMBDA_LOW
+        explicit VisibleFull(const float* data)
+        {
+            std::copy_n(data, LAMBDA_RANGE, values.begin());
+        }
+
+        [[nodiscard]] const float* data() const
+        {
+            return values.data();
+        }
 
         void print() const
         {
@@ -76,8 +90,15 @@ namespace Spectrum
     public:
         std::map<int, float> values = {};
 
+        // toVisibleFull interpolates only, the samples have to reach both ends of the visible range
+        [[nodiscard]] bool coversVisible() const
+        {
+            return !values.empty() && values.begin()->first <= VisibleFull::LAMBDA_LOW && values.rbegin()->first >= VisibleFull::LAMBDA_HIGH - 1;
+        }
+
         [[nodiscard]] VisibleFull toVisibleFull() const
         {
+            PROFILE_SCOPE("spectrum.resample");
             VisibleFull spectrum;
             for (auto l = VisibleFull::LAMBDA_LOW; l < VisibleFull::LAMBDA_HIGH; l++)
                 spectrum[l] = lerpVal(l);
@@ -127,6 +148,7 @@ namespace Spectrum
     public:
         Arbitrary parseMathematicaString(const char* data)
         {
+            PROFILE_SCOPE("spectrum.parse");
             reset();
             std::string s{data};
             Arbitrary spectrum;
@@ -1,23 +1,45 @@
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <optional>
+#include <random>
 
+#include "InputParser.h"
 #include "SpectralData.h"
 #include "Spectrum.h"
 #include "Sampler.h"
+#include "Quadrature.h"
+#include "LineSpectrum.h"
+#include "Progressive.h"
+#include "Pipeline.h"
+#include "Cache.h"
+#include "ColorTargets.h"
+#include "Multispectral.h"
+#include "Fluorescence.h"
 #include "Results.h"
 #include "ColorSpace.h"
 
 struct RunParams
 {
     int randomSampleCount = 100;
-    int equidistantSampleCount = 40;
+    int quadratureSampleCount = 40;
+    Quadrature::Method quadrature = Quadrature::Method::eMidpoint;
+    // add the luminaries' emission lines exactly, only their continuum is sampled
+    bool lines = false;
+
+    // quadratureSampleCount clamped to what the method uses, keys the cache and labels the results
+    [[nodiscard]] int quadratureSamples() const
+    {
+        return Quadrature::sampleCount(quadrature, quadratureSampleCount);
+    }
 
     void print() const
     {
         std::cout << "Random sample count: " << randomSampleCount << "\n";
-        std::cout << "Equidistant sample count: " << equidistantSampleCount << "\n";
+        std::cout << Quadrature::name(quadrature) << " sample count: " << quadratureSamples() << "\n";
     }
 };
 
@@ -27,42 +49,267 @@ public:
     SpectralMultiplication()
     {
         loadSpectralData();
-        std::cout.setf(std::ios::fixed);
-        std::cout.precision(2);
-
-        Result::REFERENCE.printT("REFERENCE");
-        std::cout << "\n";
     }
 
     void run(const RunParams& params) const
     {
-        Sampler::Uniform uSampler;
-        Sampler::Hero hSampler;
-        Result uRes, hRes, eRes;
+        Result uRes, hRes, qRes;
+        // same wavelength budget as the uniform sampler, at least one draw when the budget is below the lane count
+        const auto heroDraws = std::max(1, params.randomSampleCount / Sampler::Hero<>::LANES);
+        const Cache::SamplerConfig uConfig{ Cache::Method::eUniform, params.randomSampleCount, 0, params.lines };
+        const Cache::SamplerConfig hConfig{ Cache::Method::eHero, heroDraws, Sampler::Hero<>::LANES, params.lines };
+        const auto quadratureSamples = params.quadratureSamples();
+        const Cache::SamplerConfig qConfig{ cacheMethod(params.quadrature), quadratureSamples, 0, params.lines };
 
         for (const auto& [lumName, lumSpectrum] : luminaries)
             for (const auto& [matName, matSpectrum] : materials)
             {
-                uRes.values[lumName][matName] = ColorSpace::RGB(uSampler.eval(params.randomSampleCount, lumSpectrum, matSpectrum));
-                hRes.values[lumName][matName] = ColorSpace::RGB(hSampler.eval(params.randomSampleCount, lumSpectrum, matSpectrum));
-                eRes.values[lumName][matName] = ColorSpace::RGB(Sampler::Equidistant::eval(params.equidistantSampleCount, lumSpectrum, matSpectrum));
+                const auto& lum = lumSpectrum;
+                const auto& mat = matSpectrum;
+                const auto splitIt = lineSplits.find(lumName);
+                const auto* split = params.lines && splitIt != lineSplits.end() ? &splitIt->second : nullptr;
+                // the continuum takes the luminary's place when lines are split off
+                const auto estimate = [&](auto&& sampler)
+                {
+                    return split ? split->eval(mat, sampler) : sampler(lum, mat);
+                };
+                uRes.values[lumName][matName] = cached(uConfig, lumName, matName, [&](auto seed) { return estimate([&](const auto& l, const auto& m) { return Sampler::Uniform(seed).eval(params.randomSampleCount, l, m); }); });
+                hRes.values[lumName][matName] = cached(hConfig, lumName, matName, [&](auto seed) { return estimate([&](const auto& l, const auto& m) { return Sampler::Hero<>(seed).eval(heroDraws, l, m); }); });
+                qRes.values[lumName][matName] = cached(qConfig, lumName, matName, [&](auto)
+                {
+                    // the CMF-folded rule reads only the gathered samples, no product spectrum is built
+                    if (!split)
+                        return ColorSpace::XYZ(Quadrature::xyz(params.quadrature, quadratureSamples, lum, mat));
+                    return ColorSpace::XYZ(estimate([&](const auto& l, const auto& m) { return Quadrature::eval(params.quadrature, quadratureSamples, l, m); }));
+                });
             }
-        uRes.evalPrint("Random uniform sampling (" + std::to_string(params.randomSampleCount) + ")");
-        hRes.evalPrint("Hero wavelength sampling (" + std::to_string(params.randomSampleCount / 4) + ")");
-        eRes.evalPrint("Equidistant sampling (" + std::to_string(params.equidistantSampleCount) + ")");
+        const std::string suffix = params.lines ? " + exact lines" : "";
+        uRes.evalPrint("Random uniform sampling (" + std::to_string(params.randomSampleCount) + ")" + suffix);
+        hRes.evalPrint("Hero wavelength sampling (" + std::to_string(heroDraws) + ")" + suffix);
+        qRes.evalPrint(std::string(Quadrature::name(params.quadrature)) + " quadrature (" + std::to_string(quadratureSamples) + ")" + suffix);
     }
 
-    void runDemo() const
+    void runDemo(Quadrature::Method quadrature, bool lines) const
     {
-        Result full, uniform, hero, equidistant;
+        Result full;
         for (const auto& [lumName, lumSpectrum] : luminaries)
             for (const auto& [matName, matSpectrum] : materials)
-                full.values[lumName][matName] = ColorSpace::RGB(lumSpectrum * matSpectrum);
+            {
+                const auto& lum = lumSpectrum;
+                const auto& mat = matSpectrum;
+                full.values[lumName][matName] = cached({}, lumName, matName, [&](auto) { return lum * mat; });
+            }
         full.evalPrint("Full spectral evaluation");
 
-        run(RunParams{75, 8});
-        run(RunParams{125, 25});
-        run(RunParams{200, 45});
+        run(RunParams{75, 8, quadrature, lines});
+        run(RunParams{125, 25, quadrature, lines});
+        run(RunParams{200, 45, quadrature, lines});
+    }
+
+    void runAdaptive(const Progressive::AdaptiveParams& params) const
+    {
+        // one seed per pair, a shared wavelength sequence would correlate the errors the stopping rule looks at
+        std::vector<Progressive::Accumulator<Sampler::Hero<>>> pairs;
+        for (const auto& lumName : Result::lumSorted)
+            for (const auto& matName : Result::matSorted)
+                pairs.emplace_back(luminaries.at(lumName), materials.at(matName), static_cast<std::mt19937::result_type>(pairs.size() + 1));
+
+        Progressive::refine(pairs, params);
+
+        Result res;
+        auto total = 0LL;
+        std::cout << "Hero draws per pair (target standard error " << params.targetError << ", budget " << params.timeBudgetMs << " ms):\n";
+        for (std::size_t i = 0; i < pairs.size(); i++)
+        {
+            const auto& lumName = Result::lumSorted[i / Result::matSorted.size()];
+            const auto& matName = Result::matSorted[i % Result::matSorted.size()];
+            res.values[lumName][matName] = pairs[i].estimate();
+            total += pairs[i].sampleCount();
+            std::cout << "<" << lumName << "> <" << matName << ">\t" << pairs[i].sampleCount() << "\t+-" << pairs[i].maxStandardError() << "\n";
+        }
+        std::cout << "\n";
+        res.evalPrint("Adaptive hero wavelength sampling (" + std::to_string(total) + " draws)");
+    }
+
+    void runLibrary(std::istream& in, std::ostream& out, int threads) const
+    {
+        Pipeline::Luminaries lums;
+        for (const auto& lumName : Result::lumSorted)
+            lums.emplace_back(lumName, luminaries.at(lumName));
+
+        // reader and writer take one thread each, the rest is split between resampling and evaluation
+        Pipeline::Settings settings;
+        settings.resampleThreads = std::max(1, (threads - 2) / 2);
+        settings.evaluateThreads = std::max(1, threads - 2 - settings.resampleThreads);
+
+        const auto stats = Pipeline::LibraryEvaluator(std::move(lums), settings).run(in, out);
+        std::cerr << "Evaluated " << stats.spectra << " spectra in " << stats.seconds << " s";
+        if (stats.rejected > 0)
+            std::cerr << ", " << stats.rejected << " rejected";
+        std::cerr << "\n";
+    }
+
+    // full spectral evaluation into several output spaces with a single sweep over every product spectrum
+    void runTargets(const std::vector<ColorSpace::TargetId>& ids, bool chromaticAdaptation) const
+    {
+        const ColorSpace::SpectralBasis basis(ids, chromaticAdaptation);
+        std::vector<Result> results(ids.size());
+        std::vector<float> channels(basis.channels());
+        for (const auto& [lumName, lumSpectrum] : luminaries)
+            for (const auto& [matName, matSpectrum] : materials)
+            {
+                basis.project(lumSpectrum * matSpectrum, channels.data());
+                for (std::size_t t = 0; t < ids.size(); t++)
+                    results[t].values[lumName][matName] = ColorSpace::RGB(glm::vec3(channels[3 * t], channels[3 * t + 1], channels[3 * t + 2]));
+            }
+
+        for (std::size_t t = 0; t < ids.size(); t++)
+        {
+            results[t].printT(std::string("Full spectral evaluation <") + ColorSpace::target(ids[t]).name + ">");
+            std::cout << "\n";
+        }
+    }
+
+    // fluorescent variants of the X-Rite samples, then a synthetic batch timed in every storage
+    void runFluorescence(int materialCount, int rank, unsigned threads) const
+    {
+        ThreadPool pool(threads);
+        std::vector<Spectrum::VisibleFull> lums;
+        for (const auto& lumName : Result::lumSorted)
+            lums.push_back(luminaries.at(lumName));
+
+        // brightener-like bands, excited in the violet and re-emitted in the blue to green
+        Result plain, fluorescent;
+        for (std::size_t m = 0; m < Result::matSorted.size(); m++)
+        {
+            const auto& matName = Result::matSorted[m];
+            const auto& reflectance = materials.at(matName);
+            const Fluorescence::Material material(Fluorescence::synthetic(reflectance, 410.0f + 5.0f * m, 450.0f + 15.0f * m, 20.0f, 0.3f));
+            const auto radiance = material.radiance(lums, &pool);
+            for (std::size_t l = 0; l < lums.size(); l++)
+            {
+                plain.values[Result::lumSorted[l]][matName] = ColorSpace::RGB(lums[l] * reflectance);
+                fluorescent.values[Result::lumSorted[l]][matName] = ColorSpace::RGB(radiance[l]);
+            }
+        }
+        plain.printT("Reflectance only");
+        std::cout << "\n";
+        fluorescent.printT("Fluorescent (re-radiation matrix)");
+        std::cout << "\n";
+
+        struct Bands
+        {
+            std::size_t base;
+            float excitation, emission, width, yield;
+        };
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> excitation(400.0f, 480.0f), shift(30.0f, 120.0f), width(10.0f, 30.0f), yield(0.05f, 0.4f);
+        std::vector<Bands> bands;
+        for (auto i = 0; i < materialCount; i++)
+        {
+            const auto ex = excitation(rng);
+            bands.push_back({ i % Result::matSorted.size(), ex, ex + shift(rng), width(rng), yield(rng) });
+        }
+
+        // each phase is timed on its own: compressing the matrices, folding the matching functions through D^T
+        // (the transposed kernel), the radiance of every luminary (the matrix-matrix kernel), and the final XYZ,
+        // which is three dot products per luminary whatever the storage
+        std::cout << "Batch of " << materialCount << " materials x " << lums.size() << " luminaries, times in ms:\n";
+        std::vector<glm::vec3> reference;
+        const auto since = [](auto start) { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+        for (const auto* storageName : { "dense", "sparse", "lowrank" })
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::optional<Fluorescence::Storage>> storages(materialCount);
+            pool.parallelFor(materialCount, [&](int i, unsigned)
+            {
+                const auto& b = bands[i];
+                auto dense = Fluorescence::synthetic(materials.at(Result::matSorted[b.base]), b.excitation, b.emission, b.width, b.yield);
+                if (storageName[0] == 'd')
+                    storages[i].emplace(std::move(dense));
+                else if (storageName[0] == 's')
+                    storages[i].emplace(Fluorescence::Sparse(dense));
+                else
+                    storages[i].emplace(Fluorescence::LowRank(dense, rank));
+            });
+            const auto buildMs = since(start);
+
+            start = std::chrono::steady_clock::now();
+            std::vector<std::optional<Fluorescence::Material>> built(materialCount);
+            pool.parallelFor(materialCount, [&](int i, unsigned) { built[i].emplace(std::move(*storages[i])); });
+            std::vector<Fluorescence::Material> batch;
+            auto bytes = std::size_t{ 0 };
+            for (auto& m : built)
+            {
+                bytes += std::visit([](const auto& d) { return d.bytes(); }, m->matrix());
+                batch.push_back(std::move(*m));
+            }
+            const auto foldMs = since(start);
+
+            start = std::chrono::steady_clock::now();
+            pool.parallelFor(materialCount, [&](int i, unsigned) { static_cast<void>(batch[i].radiance(lums)); });
+            const auto radianceMs = since(start);
+
+            start = std::chrono::steady_clock::now();
+            const auto xyz = Fluorescence::evaluate(batch, lums, pool);
+            const auto xyzMs = since(start);
+
+            // relative to the brightest dense result
+            if (reference.empty())
+                reference = xyz;
+            auto scale = 0.0f, error = 0.0f;
+            for (std::size_t i = 0; i < xyz.size(); i++)
+            {
+                scale = std::max(scale, reference[i].y);
+                error = std::max({ error, std::abs(xyz[i].x - reference[i].x), std::abs(xyz[i].y - reference[i].y), std::abs(xyz[i].z - reference[i].z) });
+            }
+
+            std::cout << "<" << storageName << ">\tbuild " << buildMs
+                      << "\tD^T CMF " << foldMs
+                      << "\tD x luminaries " << radianceMs
+                      << "\tXYZ " << xyzMs
+                      << "\t" << static_cast<double>(bytes) / (1 << 20) << " MiB"
+                      << "\tmax error " << 100.0f * error / scale << " %\n";
+        }
+    }
+
+    // later runs recompute only the pairs involving a changed spectrum
+    // tabulated luminaries are split into lines + continuum from their table samples
+    void setLuminary(const std::string& name, const Spectrum::Arbitrary& spectrum)
+    {
+        storeLuminary(name, spectrum.toVisibleFull());
+        lineSplits.insert_or_assign(name, Spectrum::LineContinuum(spectrum));
+    }
+
+    // dense luminaries are split from their 1 nm samples, a stale split would be cached under the new hash
+    void setLuminary(const std::string& name, const Spectrum::VisibleFull& spectrum)
+    {
+        Spectrum::Arbitrary samples;
+        for (auto l = Spectrum::VisibleFull::LAMBDA_LOW; l < Spectrum::VisibleFull::LAMBDA_HIGH; l++)
+            samples.values[l] = spectrum[l];
+        storeLuminary(name, spectrum);
+        lineSplits.insert_or_assign(name, Spectrum::LineContinuum(samples));
+    }
+
+    void setMaterial(const std::string& name, const Spectrum::VisibleFull& spectrum)
+    {
+        materials[name] = spectrum;
+        contentHashes["M" + name] = Cache::hash(spectrum);
+    }
+
+    Cache::ResultCache::LoadStatus loadCache(const std::string& path)
+    {
+        return cache.load(path);
+    }
+
+    bool saveCache(const std::string& path) const
+    {
+        return cache.save(path);
+    }
+
+    void printCacheStats() const
+    {
+        std::cerr << "Cache: " << cache.hits() << " hits, " << cache.misses() << " misses\n";
     }
 
     void printSpectralData() const
@@ -82,62 +329,311 @@ public:
 private:
     std::unordered_map<std::string, Spectrum::VisibleFull> luminaries;
     std::unordered_map<std::string, Spectrum::VisibleFull> materials;
+    std::unordered_map<std::string, Cache::Hash> contentHashes;
+    std::unordered_map<std::string, Spectrum::LineContinuum> lineSplits;
+    mutable Cache::ResultCache cache;
+
+    static Cache::Method cacheMethod(Quadrature::Method method)
+    {
+        switch (method)
+        {
+            case Quadrature::Method::eSimpson: return Cache::Method::eSimpson;
+            case Quadrature::Method::eGaussLegendre: return Cache::Method::eGaussLegendre;
+            case Quadrature::Method::eAdaptive: return Cache::Method::eAdaptive;
+            default: return Cache::Method::eMidpoint;
+        }
+    }
+
+    void storeLuminary(const std::string& name, const Spectrum::VisibleFull& spectrum)
+    {
+        luminaries[name] = spectrum;
+        contentHashes["L" + name] = Cache::hash(spectrum);
+    }
+
+    template<typename F>
+    ColorSpace::RGB cached(const Cache::SamplerConfig& config, const std::string& lumName, const std::string& matName, F&& evalSpectrum) const
+    {
+        const Cache::Key key{ contentHashes.at("L" + lumName), contentHashes.at("M" + matName), config.hash() };
+        return ColorSpace::RGB(cache.getOrCompute(key, [&] { return ColorSpace::RGB(evalSpectrum(key.seed())).color; }));
+    }
 
     void loadSpectralData()
     {
         Spectrum::Parser p;
         // up-sampling using linear interpolation
-        luminaries[" A "] = p.parseMathematicaString(Data::CIE_Illuminant_A).toVisibleFull();
-        luminaries["D65"] = p.parseMathematicaString(Data::CIE_Illuminant_D65).toVisibleFull();
-        luminaries["F11"] = p.parseMathematicaString(Data::CIE_Illuminant_F11).toVisibleFull();
-        materials["A1"] = p.parseMathematicaString(Data::XRite_Reflectance_A1).toVisibleFull();
-        materials["E2"] = p.parseMathematicaString(Data::XRite_Reflectance_E2).toVisibleFull();
-        materials["F4"] = p.parseMathematicaString(Data::XRite_Reflectance_F4).toVisibleFull();
-        materials["G4"] = p.parseMathematicaString(Data::XRite_Reflectance_G4).toVisibleFull();
-        materials["H4"] = p.parseMathematicaString(Data::XRite_Reflectance_H4).toVisibleFull();
-        materials["J4"] = p.parseMathematicaString(Data::XRite_Reflectance_J4).toVisibleFull();
+        setLuminary(" A ", p.parseMathematicaString(Data::CIE_Illuminant_A));
+        setLuminary("D65", p.parseMathematicaString(Data::CIE_Illuminant_D65));
+        setLuminary("F11", p.parseMathematicaString(Data::CIE_Illuminant_F11));
+        setMaterial("A1", p.parseMathematicaString(Data::XRite_Reflectance_A1).toVisibleFull());
+        setMaterial("E2", p.parseMathematicaString(Data::XRite_Reflectance_E2).toVisibleFull());
+        setMaterial("F4", p.parseMathematicaString(Data::XRite_Reflectance_F4).toVisibleFull());
+        setMaterial("G4", p.parseMathematicaString(Data::XRite_Reflectance_G4).toVisibleFull());
+        setMaterial("H4", p.parseMathematicaString(Data::XRite_Reflectance_H4).toVisibleFull());
+        setMaterial("J4", p.parseMathematicaString(Data::XRite_Reflectance_J4).toVisibleFull());
     }
 };
 
-class InputParser
+// reflectance cube rendered under one of the CIE illuminants into an RGB or XYZ PFM
+int convertImage(const InputParser& input)
 {
-public:
-    InputParser (int &argc, char **argv)
+    const auto& path = input.getCmdOption("--image");
+    const auto& output = input.getCmdOption("-o");
+    if (output.empty())
     {
-        for (int i=1; i < argc; ++i)
-            tokens.emplace_back(argv[i]);
+        std::cerr << "--image needs an output file (-o)\n";
+        return EXIT_FAILURE;
     }
 
-    [[nodiscard]] const std::string& getCmdOption(const std::string& option) const
+    Multispectral::ImageDesc desc;
+    auto header = input.getCmdOption("--header");
+    if (header.empty() && std::ifstream(path + ".hdr"))
+        header = path + ".hdr";
+    if (!header.empty())
+        desc = Multispectral::readEnviHeader(header);
+    else
     {
-        if (auto itr =  std::find(tokens.cbegin(), tokens.cend(), option);itr != tokens.cend() && ++itr != tokens.end())
-            return *itr;
-        return emptyString;
+        // headerless cube, band sequential unless --interleave says otherwise, evenly spaced bands
+        const auto& x = input.getCmdOption("-x");
+        const auto& y = input.getCmdOption("-y");
+        const auto& bands = input.getCmdOption("--bands");
+        if (x.empty() || y.empty() || bands.empty())
+        {
+            std::cerr << "raw images need -x WIDTH -y HEIGHT --bands COUNT\n";
+            return EXIT_FAILURE;
+        }
+        desc.width = std::stoi(x);
+        desc.height = std::stoi(y);
+        auto low = 400.0f, high = 700.0f;
+        if (const auto& range = input.getCmdOption("--range"); !range.empty())
+        {
+            low = std::stof(range.substr(0, range.find(',')));
+            high = std::stof(range.substr(range.find(',') + 1));
+        }
+        desc.wavelengths = Multispectral::ImageDesc::evenlySpaced(std::stoi(bands), low, high);
+        if (const auto& interleave = input.getCmdOption("--interleave"); interleave == "bil")
+            desc.interleave = Multispectral::Interleave::eBIL;
+        else if (interleave == "bip")
+            desc.interleave = Multispectral::Interleave::eBIP;
+        desc.validate();
     }
 
-    [[nodiscard]] bool cmdOptionExists(const std::string& option) const
+    const char* illuminant = Data::CIE_Illuminant_D65;
+    if (const auto& name = input.getCmdOption("--illuminant"); name == "A")
+        illuminant = Data::CIE_Illuminant_A;
+    else if (name == "F11")
+        illuminant = Data::CIE_Illuminant_F11;
+    else if (!name.empty() && name != "D65")
     {
-        return std::find(tokens.cbegin(), tokens.cend(), option) != tokens.cend();
+        std::cerr << "unknown illuminant " << name << "\n";
+        return EXIT_FAILURE;
     }
-private:
-    std::vector <std::string> tokens;
-    std::string emptyString = {};
-};
+
+    auto space = ColorSpace::TargetId::eSRGB;
+    if (const auto& name = input.getCmdOption("--space"); !name.empty())
+    {
+        const auto id = ColorSpace::findTarget(name);
+        if (!id)
+        {
+            std::cerr << "unknown target " << name << "\n";
+            return EXIT_FAILURE;
+        }
+        space = *id;
+    }
+
+    Multispectral::Settings settings;
+    if (const auto o = input.getCmdOption("-t"); !o.empty())
+        settings.threads = static_cast<unsigned>(std::stoi(o));
+
+    const Multispectral::BandMatrix matrix(desc.wavelengths, Spectrum::Parser().parseMathematicaString(illuminant).toVisibleFull(),
+                                           ColorSpace::target(space).conversion(!input.cmdOptionExists("--no-adaptation")));
+    const auto stats = Multispectral::convert(path, desc, matrix, output, settings);
+    std::cerr << "Converted " << desc.width << "x" << desc.height << "x" << desc.bands() << " in " << stats.seconds << " s on "
+              << stats.threads << " threads (" << static_cast<double>(stats.pixels) / stats.seconds * 1e-6 << " Mpixel/s)\n";
+    return EXIT_SUCCESS;
+}
 
 int main(int argc, char **argv)
 {
     const InputParser input(argc, argv);
     if (argc == 1 || input.cmdOptionExists("-h") || input.cmdOptionExists("--help"))
     {
-        std::cout << "spectrum [-n RANDOM_SAMPLE_COUNT] [-m EQUIDISTANT_SAMPLE_COUNT]\n";
-        std::cout << "spectrum --demo\n";
+        std::cout << "spectrum [-n RANDOM_SAMPLE_COUNT] [-m QUADRATURE_SAMPLE_COUNT] [-q midpoint|simpson|gauss|adaptive] [--lines] [--cache FILE] [--profile]\n";
+        std::cout << "spectrum --demo [-q midpoint|simpson|gauss|adaptive] [--lines] [--cache FILE] [--profile]\n";
+        std::cout << "spectrum --targets srgb,rec2020,acescg,p3,xyz [--no-adaptation] [--profile]\n";
+        std::cout << "spectrum --library FILE [-o OUTPUT] [-t THREADS] [--profile]\n";
+        std::cout << "spectrum --image FILE -o OUTPUT.pfm [--header FILE.hdr | -x WIDTH -y HEIGHT --bands COUNT [--range LOW,HIGH] [--interleave bsq|bil|bip]]\n"
+                     "         [--illuminant A|D65|F11] [--space srgb|rec2020|acescg|p3|xyz] [-t THREADS] [--profile]\n";
+        std::cout << "spectrum --fluorescence [--materials COUNT] [--rank K>=1] [-t THREADS] [--profile]\n";
+        std::cout << "spectrum --adaptive [-e TARGET_STANDARD_ERROR] [-b TIME_BUDGET_MS] [--profile]\n";
+        return EXIT_SUCCESS;
+    }
+
+    const auto profile = input.cmdOptionExists("--profile");
+    if (profile)
+        Profiler::enable();
+
+    std::cout.setf(std::ios::fixed);
+    std::cout.precision(2);
+
+    if (!input.getCmdOption("--image").empty())
+    {
+        try
+        {
+            const auto status = convertImage(input);
+            if (profile)
+                Profiler::printJson(std::cerr);
+            return status;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    SpectralMultiplication sm;
+    if (const auto library = input.getCmdOption("--library"); !library.empty())
+    {
+        std::ifstream in(library);
+        if (!in)
+        {
+            std::cerr << "cannot open " << library << "\n";
+            return EXIT_FAILURE;
+        }
+        auto threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (const auto o = input.getCmdOption("-t"); !o.empty())
+            threads = std::stoi(o);
+
+        if (const auto output = input.getCmdOption("-o"); !output.empty())
+        {
+            std::ofstream out(output);
+            if (!out)
+            {
+                std::cerr << "cannot open " << output << "\n";
+                return EXIT_FAILURE;
+            }
+            out.setf(std::ios::fixed);
+            out.precision(4);
+            sm.runLibrary(in, out, threads);
+            if (!out.flush())
+            {
+                std::cerr << "cannot write " << output << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        else
+            sm.runLibrary(in, std::cout, threads);
+
+        if (profile)
+            Profiler::printJson(std::cerr);
+        return EXIT_SUCCESS;
+    }
+
+    if (const auto list = input.getCmdOption("--targets"); !list.empty())
+    {
+        std::vector<ColorSpace::TargetId> ids;
+        std::size_t begin = 0;
+        while (begin <= list.size())
+        {
+            const auto end = std::min(list.find(',', begin), list.size());
+            const auto name = list.substr(begin, end - begin);
+            const auto id = ColorSpace::findTarget(name);
+            if (!id)
+            {
+                std::cerr << "unknown target " << name << "\n";
+                return EXIT_FAILURE;
+            }
+            ids.push_back(*id);
+            begin = end + 1;
+        }
+        sm.runTargets(ids, !input.cmdOptionExists("--no-adaptation"));
+        if (profile)
+            Profiler::printJson(std::cerr);
+        return EXIT_SUCCESS;
+    }
+
+    if (input.cmdOptionExists("--fluorescence"))
+    {
+        auto materialCount = 256, rank = 4;
+        auto threads = 0u;
+        if (const auto o = input.getCmdOption("--materials"); !o.empty())
+            materialCount = std::max(1, std::stoi(o));
+        if (const auto o = input.getCmdOption("--rank"); !o.empty())
+            rank = std::stoi(o);
+        if (rank < 1)
+        {
+            std::cerr << "--rank needs K >= 1, K = 0 would drop all re-radiation\n";
+            return EXIT_FAILURE;
+        }
+        if (const auto o = input.getCmdOption("-t"); !o.empty())
+            threads = static_cast<unsigned>(std::stoi(o));
+        sm.runFluorescence(materialCount, rank, threads);
+        if (profile)
+            Profiler::printJson(std::cerr);
         return EXIT_SUCCESS;
     }
 
-    const SpectralMultiplication sm;
-    if (argc == 2 && input.cmdOptionExists("--demo"))
+    const auto& cacheFile = input.getCmdOption("--cache");
+    if (!cacheFile.empty())
     {
-        sm.runDemo();
+        using LoadStatus = Cache::ResultCache::LoadStatus;
+        const auto status = sm.loadCache(cacheFile);
+        // refused here as saving would refuse to overwrite it anyway
+        if (status == LoadStatus::eForeign)
+        {
+            std::cerr << cacheFile << " is not a result cache\n";
+            return EXIT_FAILURE;
+        }
+        if (status == LoadStatus::eTruncated)
+            std::cerr << cacheFile << " is truncated, starting with an empty cache\n";
+    }
+    // false when the cache could not be written
+    const auto saveCache = [&]()
+    {
+        if (cacheFile.empty())
+            return true;
+        sm.printCacheStats();
+        if (sm.saveCache(cacheFile))
+            return true;
+        std::cerr << "cannot write cache " << cacheFile << "\n";
+        return false;
+    };
+
+    Result::REFERENCE.printT("REFERENCE");
+    std::cout << "\n";
+
+    auto quadrature = Quadrature::Method::eMidpoint;
+    if (const auto& q = input.getCmdOption("-q"); q == "simpson")
+        quadrature = Quadrature::Method::eSimpson;
+    else if (q == "gauss")
+        quadrature = Quadrature::Method::eGaussLegendre;
+    else if (q == "adaptive")
+        quadrature = Quadrature::Method::eAdaptive;
+    else if (!q.empty() && q != "midpoint")
+    {
+        std::cerr << "unknown quadrature " << q << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (input.cmdOptionExists("--demo"))
+    {
+        sm.runDemo(quadrature, input.cmdOptionExists("--lines"));
+        const auto saved = saveCache();
+        if (profile)
+            Profiler::printJson(std::cerr);
+        return saved ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (input.cmdOptionExists("--adaptive"))
+    {
+        Progressive::AdaptiveParams adaptive;
+        if (const auto o = input.getCmdOption("-e"); !o.empty())
+            adaptive.targetError = std::stod(o);
+        if (const auto o = input.getCmdOption("-b"); !o.empty())
+            adaptive.timeBudgetMs = std::stod(o);
+        sm.runAdaptive(adaptive);
+        if (profile)
+            Profiler::printJson(std::cerr);
         return EXIT_SUCCESS;
     }
 
@@ -145,9 +641,14 @@ int main(int argc, char **argv)
     if (const auto o = input.getCmdOption("-n"); !o.empty())
         params.randomSampleCount = std::stoi(o);
     if (const auto o = input.getCmdOption("-m"); !o.empty())
-        params.equidistantSampleCount = std::stoi(o);
+        params.quadratureSampleCount = std::stoi(o);
+    params.quadrature = quadrature;
+    params.lines = input.cmdOptionExists("--lines");
 
     sm.run(params);
+    const auto saved = saveCache();
+    if (profile)
+        Profiler::printJson(std::cerr);
 
-    return EXIT_SUCCESS;
+    return saved ? EXIT_SUCCESS : EXIT_FAILURE;
 }